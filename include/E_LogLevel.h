@@ -62,10 +62,11 @@ enum E_LogLevel
     // be logged to two additional files. This level will generate a
     // very large amount of data and is appropriate when debugging
     // issues with the CAN message generation, the CAN protocol
-    // itself, or issues with the FPU firmware. Because messages are
-    // sent from within high-priority event loops, enabling this level
-    // will degrade the responsiveness of the driver. It is not
-    // designed to be used during normal instrument operation.
+    // itself, or issues with the FPU firmware. The event loops only
+    // store binary records of the messages, which are formatted and
+    // written by a background thread (see CANLog.h). If the writer
+    // cannot keep up, records are dropped, and the number of dropped
+    // records is written to the log.
     LOG_TRACE_CAN_MESSAGES = 5,
 
 };
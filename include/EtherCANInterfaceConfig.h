@@ -56,8 +56,21 @@ public:
     // file descriptor for log of all received CAN responses (RX)
     int fd_rxlog;
 
+    // file descriptor for the binary capture of all sent and
+    // received CAN messages (see ethercan/CANCapture.h). This is
+    // independent of the log level.
+    int fd_capturelog;
+
     int num_fpus;
 
+    // layout of the grid. FPU ids are assigned along each CAN bus,
+    // then along the buses of a gateway, and then along the
+    // gateways, so that the number of gateways which are needed
+    // follows from num_fpus. The internal structures of the driver
+    // are sized for this layout by initializeInterface().
+    int buses_per_gateway; // CAN buses used on each gateway
+    int fpus_per_bus;      // FPUs on each CAN bus
+
     // offset with which alpha arm angles are computed from step counts
     double alpha_datum_offset;
 
@@ -76,6 +89,61 @@ public:
     int min_bus_repeat_delay_ms; // delay, in milliseconds, before writing to the same CAN bus
     int min_fpu_repeat_delay_ms; // delay, in milliseconds, before writing to the same FPU
 
+    bool tx_bus_interleaving; // interleave messages to different CAN
+                              // buses of a gateway, instead of sending
+                              // them in the order of the command queue
+
+    int tx_batch_bytes; // maximum number of bytes which are collected
+                        // and written to a gateway socket with one
+                        // send() call. Values smaller than two stuffed
+                        // messages send each message on its own.
+
+    bool io_thread_per_gateway; // serve each gateway by its own pair of
+                                // TX and RX threads, which wait with
+                                // edge-triggered epoll, instead of one
+                                // TX and one RX thread for all gateways
+
+    int tx_thread_cpu[MAX_NUM_GATEWAYS]; // CPU to which the TX thread of
+                                         // each gateway is pinned, or -1
+                                         // for no pinning. With a single
+                                         // TX thread, the first entry
+                                         // applies.
+    int rx_thread_cpu[MAX_NUM_GATEWAYS]; // the same for the RX threads
+
+    bool busy_poll; // let the TX and RX threads spin with non-blocking
+                    // send() and recv() calls before they block in
+                    // ppoll() or epoll_wait(). This trades one busy
+                    // CPU per thread for a lower and more
+                    // deterministic response latency.
+    int busy_poll_budget_us; // time, in microseconds, for which the
+                             // threads keep spinning without traffic
+                             // before they block again
+    int socket_busy_poll_us; // value of the SO_BUSY_POLL option of the
+                             // gateway sockets in busy-poll mode, in
+                             // microseconds, or zero to leave it unset.
+                             // Values above net.core.busy_read need
+                             // CAP_NET_ADMIN.
+
+    // real-time profile. The result is checked by connect(), and
+    // can be read with getRealTimeStatus().
+    bool rt_scheduling; // run the TX and RX threads with the SCHED_FIFO
+                        // policy, and raise the thread which calls
+                        // connect(), executeMotion() and abortMotion()
+                        // to SCHED_FIFO for the duration of these
+                        // calls. This needs CAP_SYS_NICE or a
+                        // sufficient RLIMIT_RTPRIO.
+    int rt_control_priority; // SCHED_FIFO priorities of the calling thread,
+    int rt_tx_priority;      // the TX threads,
+    int rt_rx_priority;      // and the RX threads
+    bool lock_memory; // let initializeInterface() lock all current and
+                      // future pages into memory with mlockall(), keep
+                      // freed heap memory in the process, and pre-fault
+                      // a heap reserve and the stacks of the driver
+                      // threads, so that no page faults delay
+                      // time-critical commands. Locking needs
+                      // CAP_IPC_LOCK or an unlimited RLIMIT_MEMLOCK,
+                      // otherwise only the pre-faulting is done.
+
     int firmware_version_address_offset;
     int configmotion_confirmation_period;
     int can_command_priority; // maximum priority of CAN commands; this is a four-bit value
@@ -85,11 +153,22 @@ public:
     int configmotion_max_resend_count; // number of times all data
 				       // will be resent silently on a
 				       // low level.
+    int configmotion_window; // if larger than zero, configMotion()
+                             // uploads the waveforms of all FPUs
+                             // independently, with at most this
+                             // number of unconfirmed segments in
+                             // flight per FPU. Zero selects the
+                             // lock-step upload.
+    bool configmotion_skip_unchanged; // if set, configMotion() does not
+                                      // upload waveforms which are
+                                      // already loaded
 
     EtherCANInterfaceConfig()
         : logLevel(LOG_TRACE_CAN_MESSAGES)
     {
-        num_fpus = MAX_NUM_POSITIONERS;
+        num_fpus = DEFAULT_NUM_POSITIONERS;
+        buses_per_gateway = ethercanif::BUSES_PER_GATEWAY;
+        fpus_per_bus = ethercanif::FPUS_PER_BUS;
 
         // set default time-out values
 
@@ -104,8 +183,26 @@ public:
 
 	min_bus_repeat_delay_ms = 2;
 	min_fpu_repeat_delay_ms = 4;
+	tx_bus_interleaving = true;
+	tx_batch_bytes = 4096;
+	io_thread_per_gateway = false;
+	for (int i=0; i < MAX_NUM_GATEWAYS; i++)
+	{
+	    tx_thread_cpu[i] = -1;
+	    rx_thread_cpu[i] = -1;
+	}
+	busy_poll = false;
+	busy_poll_budget_us = 500;
+	socket_busy_poll_us = 50;
+	rt_scheduling = false;
+	rt_control_priority = 1;
+	rt_tx_priority = 2;
+	rt_rx_priority = 3;
+	lock_memory = false;
 	configmotion_max_retry_count = 10;
 	configmotion_max_resend_count = 5;
+	configmotion_window = 0;
+	configmotion_skip_unchanged = false;
 
         firmware_version_address_offset = 0x61; // new offset for v1.3.0, matching firmware version 1.4.4
 
@@ -113,6 +210,7 @@ public:
         fd_controllog = -1;
         fd_rxlog = -1;
         fd_txlog = -1;
+        fd_capturelog = -1;
 
         alpha_datum_offset = ALPHA_DATUM_OFFSET;
         motor_minimum_frequency = 500.0;
@@ -38,17 +38,27 @@ static const int DEFAULT_GATEWAY_PORT = 4700;
 
 
 // number of gateways for the positioner grid
-const int MAX_NUM_GATEWAYS = 3;
+const int DEFAULT_NUM_GATEWAYS = 3;
 
-// maximum number of fibre positioner units
-const int MAX_NUM_POSITIONERS = (MAX_NUM_GATEWAYS
-                                 * ethercanif::BUSES_PER_GATEWAY
-                                 * ethercanif::FPUS_PER_BUS);
+// maximum number of gateways which can be connected
+const int MAX_NUM_GATEWAYS = 8;
+
+// number of fibre positioner units of the grid, which
+// is the default of the configuration
+const int DEFAULT_NUM_POSITIONERS = (DEFAULT_NUM_GATEWAYS
+                                     * ethercanif::BUSES_PER_GATEWAY
+                                     * ethercanif::FPUS_PER_BUS);
 
-const int MAX_FPUS_PER_GATEWAY = (ethercanif::BUSES_PER_GATEWAY
-                                  * ethercanif::FPUS_PER_BUS);
+const int DEFAULT_FPUS_PER_GATEWAY = (ethercanif::BUSES_PER_GATEWAY
+                                      * ethercanif::FPUS_PER_BUS);
 
-const bool USE_REALTIME_SCHEDULING = false;
+// maximum number of fibre positioner units, for the largest
+// layout which can be configured. The internal structures are
+// sized for the configured number of FPUs, only sets of FPU ids
+// (t_fpuset) have this size.
+const int MAX_NUM_POSITIONERS = (MAX_NUM_GATEWAYS
+                                 * ethercanif::MAX_BUSES_PER_GATEWAY
+                                 * ethercanif::MAX_FPUS_PER_BUS);
 
 
 /* Design scaling of stepper motors.
@@ -23,6 +23,9 @@
 
 #include <time.h>
 #include <stdint.h>
+
+#include <vector>
+
 #include "InterfaceConstants.h"
 #include "FPUState.h"
 #include "ethercan/E_CAN_COMMAND.h"
@@ -38,8 +41,10 @@ typedef int t_counts[NUM_FPU_STATES];
 typedef struct
 {
     // individual states of each FPU. The index
-    // is always the logical ID of each FPU.
-    t_fpu_state FPU_state[MAX_NUM_POSITIONERS];
+    // is always the logical ID of each FPU. The driver
+    // resizes it to the configured number of FPUs when the
+    // state is retrieved.
+    std::vector<t_fpu_state> FPU_state;
 
     // count of each FPU state
     t_counts Counts;
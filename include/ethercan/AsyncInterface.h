@@ -20,6 +20,8 @@
 #define ASYNC_INTERFACE_H
 
 #include <cmath>
+#include <array>
+#include <vector>
 #include "../EtherCANInterfaceConfig.h"
 #include "GatewayInterface.h"
 #include "../InterfaceConstants.h"
@@ -53,6 +55,17 @@ public:
 
     typedef E_DATUM_SEARCH_DIRECTION t_datum_search_flags[MAX_NUM_POSITIONERS];
 
+    // counts of FPUs and configMotion CAN frames in the
+    // last call to configMotionAsync()
+    typedef struct
+    {
+        int num_fpus_loaded;    // waveform was uploaded
+        int num_fpus_skipped;   // identical waveform was already ready
+        int num_fpus_repeated;  // identical waveform was re-activated by repeatMotion
+        long num_frames_sent;   // segments which were uploaded
+        long num_frames_skipped; // segments which did not need to be uploaded
+    } t_waveform_upload_stats;
+
     /* Maximum number of retries to initialize configure
        motion before the driver will give up. */
     const int MAX_CONFIG_MOTION_RETRIES = 5;
@@ -63,10 +76,9 @@ public:
         num_gateways = 0;
         log_repeat_count = 0;
 
-        // initialize known firmware versions to zero
-
-
-        memset(fpu_firmware_version, FIRMWARE_NOT_RETRIEVED, sizeof(fpu_firmware_version));
+        // the caches of firmware versions and loaded waveforms
+        // are allocated in initializeInterface()
+        memset(&last_upload_stats, 0, sizeof(last_upload_stats));
 
 #if CAN_PROTOCOL_VERSION == 1
         // initialize field which records last arm selection
@@ -108,6 +120,8 @@ public:
     E_EtherCANErrCode initializeGridAsync(t_grid_state& grid_state, E_GridState& state_summary, t_fpuset const &fpuset);
 
     // get count of states across FPUs in a grid or sub-set of the grid.
+    // The count of a sub-set reflects the current state, which can be
+    // newer than grid_state.
 
     void getStateCount(const t_grid_state& grid_state, t_fpuset const * const pfpuset, t_counts &counts);
 
@@ -220,6 +234,64 @@ public:
 
     E_GridState getGridState(t_grid_state& out_state) const;
 
+    // Cheaper variants of getGridState(). The first copies only the
+    // FPUs in fpuset, the second only the grid-wide counters.  All
+    // other entries of out_state are left unchanged.
+    E_GridState getGridStateSubset(t_grid_state& out_state, t_fpuset const &fpuset) const;
+
+    E_GridState getGridCounters(t_grid_state& out_state) const;
+
+    // total time in milliseconds spent in gateway delay
+    // messages since the interface was created
+    unsigned long getInsertedDelayMs() const;
+
+    // FPU and frame counts of the last waveform upload
+    t_waveform_upload_stats getWaveformUploadStats() const;
+
+    // usage and high-water mark of the command instance pool
+    void getCommandPoolStats(E_CAN_COMMAND cmd_code, CommandPool::t_pool_stats& stats) const;
+
+    // latency histogram of one stage of the command life cycle,
+    // for one command type, or all types for CCMD_NO_COMMAND
+    // (see LatencyHistogram.h)
+    void getLatencyHistogram(E_LATENCY_METRIC metric, E_CAN_COMMAND cmd_code,
+                             t_latency_histogram& out_histogram) const;
+
+    void resetLatencyHistograms();
+
+    // counters of the socket and CAN bus traffic, per gateway
+    // and bus (see IOStatistics.h)
+    void getIOStatistics(t_io_stats& out_stats) const;
+
+    // real-time guarantees which were obtained at initialization
+    // and when connecting (see RealTimeStatus.h)
+    void getRealTimeStatus(t_rt_status& out_status) const;
+
+    // Subscribes to the state change events of the FPUs, which
+    // are published whenever a response or time-out is processed
+    // (see EventQueue.h). Up to FPUArray::MAX_EVENT_SUBSCRIPTIONS
+    // subscriptions can exist at the same time, and each one must
+    // only be read by one thread at a time.
+    E_EtherCANErrCode subscribeEvents(int& subscription_id);
+
+    E_EtherCANErrCode unsubscribeEvents(int subscription_id);
+
+    // Copies up to max_events events into the events array, waiting
+    // up to max_wait_time seconds if none are available (a negative
+    // value waits without limit).
+    E_EtherCANErrCode readEvents(int subscription_id, t_fpu_event* events,
+                                 int max_events, int& num_events,
+                                 double max_wait_time);
+
+    // file descriptor which becomes readable when new events are
+    // available after readEvents() has returned all pending events,
+    // for use with poll() or select()
+    int getEventDescriptor(int subscription_id) const;
+
+    // number of events dropped because the queue of the
+    // subscription was full
+    unsigned long getNumDroppedEvents(int subscription_id) const;
+
     E_GridState waitForState(E_WaitTarget target,
                              t_grid_state& out_detailed_state,
                              double &max_wait_time,
@@ -269,7 +341,7 @@ protected:
 
     void getFPUsetOpt(t_fpuset const * const fpuset_opt, t_fpuset &fpuset) const;
 
-    int countMoving(const t_grid_state &grid_state, t_fpuset const &fpuset) const;
+    int countMoving(t_fpuset const &fpuset) const;
 
     // make sure we have a certain minimum firmware version
     E_EtherCANErrCode assureMinFirmwareVersion(const int req_fw_major,
@@ -292,12 +364,37 @@ protected:
     E_EtherCANErrCode writeSerialNumberAsync(int fpu_id, const char serial_number[],
             t_grid_state& grid_state,
             E_GridState& state_summary);
+
+    // upload waveforms with a sliding window of unconfirmed
+    // segments per FPU (used by configMotionAsync())
+    E_EtherCANErrCode uploadWaveformsPipelined(t_grid_state& grid_state,
+            E_GridState& state_summary,
+            const t_wtable& waveforms,
+            t_fpuset const &fpuset,
+            const int min_stepcount,
+            std::vector<int>& alpha_cur,
+            std::vector<int>& beta_cur,
+            unsigned long &old_count_timeout);
 private:
 
     int num_gateways;
 
     // cached firmware version of each FPU
-    uint8_t fpu_firmware_version[MAX_NUM_POSITIONERS][3];
+    std::vector<std::array<uint8_t, 3>> fpu_firmware_version;
+
+    // copy of the waveform table which was last loaded
+    // successfully into an FPU
+    typedef struct
+    {
+        std::vector<t_step_pair> steps;
+        bool valid;
+    } t_loaded_waveform;
+
+    std::vector<t_loaded_waveform> loaded_waveforms;
+
+    static bool isLoadedWaveform(const t_waveform& waveform, const t_loaded_waveform& loaded);
+
+    t_waveform_upload_stats last_upload_stats;
 
     GatewayInterface gateway;
 #if CAN_PROTOCOL_VERSION == 1
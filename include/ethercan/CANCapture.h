@@ -0,0 +1,180 @@
+// -*- mode: c++ -*-
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME CANCapture.h
+//
+// This file defines the binary capture format of the CAN traffic,
+// and functions which decode captured records.
+//
+// A capture file is a sequence of packed 16-byte records. Each
+// connection of the driver starts with a session record, which
+// holds the real time of the session start. The time stamps of the
+// following records count microseconds of the monotonic clock since
+// the session start.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CAN_CAPTURE_H
+#define CAN_CAPTURE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../InterfaceConstants.h"
+#include "CAN_Constants.h"
+#include "E_CAN_COMMAND.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+enum E_CAPTURE_RECORD_TYPE : uint8_t
+{
+    CRT_SESSION       = 0, // start of a session
+    CRT_TX_COMMAND    = 1, // message sent to an FPU or bus
+    CRT_TX_DELAY      = 2, // gateway delay message
+    CRT_RX_RESPONSE   = 3, // message received from an FPU
+};
+
+// identifies session records, and the version of the format
+const uint16_t CAPTURE_MAGIC = 0x5ca;
+
+// largest time stamp of a record; a new session is started
+// before it overflows (after about 12 days)
+const uint64_t MAX_CAPTURE_TIME_US = (uint64_t(1) << 40) - 1;
+
+
+// The packed record. The header holds, in little-endian order:
+//
+//   bits  0-39 : time stamp in microseconds since the session start
+//   bits 40-41 : record type (E_CAPTURE_RECORD_TYPE)
+//   bits 42-45 : payload length
+//   bit  46    : the message was truncated
+//   bit  47    : high bit of the gateway id
+//   bits 48-58 : CAN identifier (CAPTURE_MAGIC for session records)
+//   bits 59-61 : CAN bus id, or GW_MSG_TYPE_SYNC for SYNC messages
+//   bits 62-63 : low bits of the gateway id
+//
+// Bit 47 was always zero before more than four gateways were
+// supported, so that older captures are decoded correctly.
+//
+// For session records, the payload holds the real time of the
+// session start, in nanoseconds since the epoch.
+typedef struct t_capture_record
+{
+    uint8_t header[8];
+    uint8_t payload[MAX_CAN_PAYLOAD_BYTES];
+} t_capture_record;
+
+static_assert(sizeof(t_capture_record) == 16, "capture records must have a fixed size");
+static_assert(MAX_NUM_GATEWAYS <= 8, "gateway id must fit into three bits");
+static_assert(MAX_BUSES_PER_GATEWAY <= 8, "bus id must fit into three bits");
+
+
+// unpacked contents of a capture record
+typedef struct t_capture_message
+{
+    uint64_t time_us;
+    uint8_t type;            // E_CAPTURE_RECORD_TYPE
+    uint8_t gateway_id;
+    uint8_t busid;           // GW_MSG_TYPE_SYNC for SYNC messages
+    uint8_t len;             // CAN payload length
+    bool truncated;
+    uint16_t can_identifier;
+    uint8_t payload[MAX_CAN_PAYLOAD_BYTES];
+} t_capture_message;
+
+
+inline void pack_capture_record(const t_capture_message& msg, t_capture_record& rec)
+{
+    const uint64_t header = ((msg.time_us & MAX_CAPTURE_TIME_US)
+                             | (uint64_t(msg.type & 0x03) << 40)
+                             | (uint64_t(msg.len & 0x0f) << 42)
+                             | (uint64_t(msg.truncated ? 1 : 0) << 46)
+                             | (uint64_t((msg.gateway_id >> 2) & 0x01) << 47)
+                             | (uint64_t(msg.can_identifier & 0x7ff) << 48)
+                             | (uint64_t(msg.busid & 0x07) << 59)
+                             | (uint64_t(msg.gateway_id & 0x03) << 62));
+    for (int i=0; i < 8; i++)
+    {
+        rec.header[i] = uint8_t(header >> (8 * i));
+    }
+    memcpy(rec.payload, msg.payload, MAX_CAN_PAYLOAD_BYTES);
+}
+
+
+inline void unpack_capture_record(const t_capture_record& rec, t_capture_message& msg)
+{
+    uint64_t header = 0;
+    for (int i=0; i < 8; i++)
+    {
+        header |= uint64_t(rec.header[i]) << (8 * i);
+    }
+    msg.time_us = header & MAX_CAPTURE_TIME_US;
+    msg.type = (header >> 40) & 0x03;
+    msg.len = (header >> 42) & 0x0f;
+    msg.truncated = ((header >> 46) & 0x01) != 0;
+    msg.can_identifier = (header >> 48) & 0x7ff;
+    msg.busid = (header >> 59) & 0x07;
+    msg.gateway_id = ((header >> 62) & 0x03) | (((header >> 47) & 0x01) << 2);
+    memcpy(msg.payload, rec.payload, MAX_CAN_PAYLOAD_BYTES);
+}
+
+
+// returns true if the record starts a session, and
+// sets the real time of the session start
+inline bool is_capture_session(const t_capture_message& msg, uint64_t& session_realtime_ns)
+{
+    if ((msg.type != CRT_SESSION) || (msg.can_identifier != CAPTURE_MAGIC))
+    {
+        return false;
+    }
+    memcpy(&session_realtime_ns, msg.payload, sizeof(session_realtime_ns));
+    return true;
+}
+
+
+enum E_CAPTURE_TEXT_FORMAT
+{
+    CTF_TEXT = 0, // one line per message
+    CTF_CSV  = 1, // comma-separated values, with header line
+};
+
+
+// returns the name of a command code. Response codes which are
+// shared with commands are resolved by the direction.
+const char* can_command_name(const uint8_t cmd_code, const bool is_response);
+
+// returns the FPU id of a message, using the address mapping of
+// the driver for the given layout, or -1 for broadcast messages
+int capture_fpu_id(const t_capture_message& msg,
+                   const int buses_per_gateway=BUSES_PER_GATEWAY,
+                   const int fpus_per_bus=FPUS_PER_BUS);
+
+// formats a captured message as a text line, and returns the number
+// of characters. The layout is used for the FPU id.
+int format_capture_message(const t_capture_message& msg, const E_CAPTURE_TEXT_FORMAT format,
+                           const uint64_t session_realtime_ns,
+                           char* buf, const int buf_len,
+                           const int buses_per_gateway=BUSES_PER_GATEWAY,
+                           const int fpus_per_bus=FPUS_PER_BUS);
+
+// returns the header line for the CSV format
+const char* capture_csv_header();
+
+}
+
+}
+
+#endif
@@ -0,0 +1,259 @@
+// -*- mode: c++ -*-
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME CANLog.h
+//
+// This class implements the trace log of CAN messages. The TX and RX
+// threads store compact binary records in lock-free ring buffers, and
+// a background thread formats them and writes them to the TX and RX
+// log files, and to the binary capture file.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CAN_LOG_H
+#define CAN_LOG_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "../EtherCANInterfaceConfig.h"
+#include "../InterfaceConstants.h"
+#include "../InterfaceState.h"
+#include "CANCapture.h"
+#include "time_utils.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+class CANLog
+{
+public:
+
+    // Each gateway has a TX and an RX ring, and each ring has a
+    // single producer. The TX ring is written by the TX thread which
+    // serves the gateway (and by the control thread while the SYNC
+    // configuration is sent in connect(), before the TX thread is
+    // started), the RX ring by the RX thread.
+    enum E_LogRing
+    {
+        RING_TX = 0,
+        RING_RX = 1,
+
+        NUM_RINGS = 2,
+    };
+
+    enum E_LogEvent : uint8_t
+    {
+        // gateway delay message which is pre-pended to a command
+        EV_TX_DELAY_MESSAGE = 0,
+        // CAN command which is appended to the write buffer
+        EV_TX_COMMAND       = 1,
+        // a batch was sent only partially
+        EV_TX_PENDING_BYTES = 2,
+        // CAN response which is dispatched to the FPU array
+        EV_RX_RESPONSE      = 3,
+    };
+
+    // number of records per ring. At the maximum rate of the CAN
+    // buses, this covers more than 100 milliseconds.
+    static const int RING_CAPACITY = 16 * 1024;
+
+    // time the writer thread sleeps when all rings are empty
+    static const long WRITER_SLEEP_NS = 2 * 1000 * 1000;
+
+    CANLog();
+
+    ~CANLog();
+
+    void setConfig(const EtherCANInterfaceConfig &config_vals);
+
+    // allocates the rings of the first num_gateways gateways, if
+    // this was not done before. Messages can only be logged for
+    // gateways whose rings are allocated. This must not be called
+    // while the writer thread runs.
+    void allocateRings(const int num_gateways);
+
+    // returns true if the event is written to the text log
+    // with the configured log level
+    bool isTextEnabled(const E_LogRing ring, const E_LogEvent event) const
+    {
+        return ((config.logLevel >= event_level(event))
+                && (((ring == RING_TX) ? config.fd_txlog : config.fd_rxlog) >= 0));
+    }
+
+    // returns true if the event is written to the capture file
+    bool isCaptureEnabled(const E_LogEvent event) const
+    {
+        return ((config.fd_capturelog >= 0) && (event != EV_TX_PENDING_BYTES));
+    }
+
+    // stores a record for a CAN message, without blocking. If the
+    // ring is full, the record is dropped and counted. Sent messages
+    // are passed as complete gateway messages, and canid is the CAN
+    // id of the FPU. Responses are passed as CAN payload, and canid
+    // is the CAN identifier. The value is the gateway delay for
+    // EV_TX_DELAY_MESSAGE, the number of unsent bytes for
+    // EV_TX_PENDING_BYTES, and the received payload length for
+    // EV_RX_RESPONSE.
+    void logMessage(const E_LogRing ring, const E_LogEvent event,
+                    const int gateway_id, const int busid,
+                    const int canid, const uint8_t* bytes,
+                    const int len, const int value=0)
+    {
+        if (! (isTextEnabled(ring, event) || isCaptureEnabled(event)))
+        {
+            return;
+        }
+
+        t_ring& r = rings[ring][gateway_id];
+        const uint64_t h = r.head.load(std::memory_order_relaxed);
+        if ((h - r.cached_tail) >= RING_CAPACITY)
+        {
+            r.cached_tail = r.tail.load(std::memory_order_acquire);
+            if ((h - r.cached_tail) >= RING_CAPACITY)
+            {
+                r.num_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        t_log_record& rec = r.records[h % RING_CAPACITY];
+        timespec now;
+        get_monotonic_time(now);
+        rec.timestamp_ns = uint64_t(now.tv_sec) * 1000000000UL + uint64_t(now.tv_nsec);
+        rec.value = value;
+        rec.canid = uint16_t(canid);
+        rec.event = event;
+        rec.gateway_id = uint8_t(gateway_id);
+        rec.busid = uint8_t(busid);
+
+        const int nbytes = (len < 0) ? 0 : ((len > MAX_UNENCODED_GATEWAY_MESSAGE_BYTES)
+                                            ? MAX_UNENCODED_GATEWAY_MESSAGE_BYTES : len);
+        rec.len = uint8_t(nbytes);
+        rec.truncated = (len != nbytes);
+        for (int i=0; i < nbytes; i++)
+        {
+            rec.payload[i] = bytes[i];
+        }
+
+        r.head.store(h + 1, std::memory_order_release);
+    }
+
+    // starts the writer thread, which runs with normal
+    // (non-real-time) scheduling priority.
+    E_EtherCANErrCode start();
+
+    // stops the writer thread after all stored records are
+    // written. This needs to be called after the producing threads
+    // have finished.
+    void stop();
+
+    // number of records which were dropped because a ring was full,
+    // since the driver was created. This method is thread-safe.
+    unsigned long getNumDropped() const;
+
+private:
+
+    // binary record of one logged message
+    typedef struct t_log_record
+    {
+        uint64_t timestamp_ns; // CLOCK_MONOTONIC
+        int32_t value;
+        uint16_t canid;
+        uint8_t event;
+        uint8_t gateway_id;
+        uint8_t busid;
+        uint8_t len;
+        uint8_t truncated;
+        uint8_t payload[MAX_UNENCODED_GATEWAY_MESSAGE_BYTES];
+    } t_log_record;
+
+    // single-producer, single-consumer ring, see RingBuffer.h for
+    // the scheme of the indices
+    typedef struct t_ring
+    {
+        std::vector<t_log_record> records;
+        char pad0[64];
+        std::atomic<uint64_t> head;
+        uint64_t cached_tail; // last tail value seen by the producer
+        char pad1[64];
+        std::atomic<uint64_t> tail;
+        std::atomic<unsigned long> num_dropped;
+        unsigned long num_reported; // dropped records which were logged
+        char pad2[64];
+    } t_ring;
+
+    static E_LogLevel event_level(const E_LogEvent event)
+    {
+        // the gateway delay is already logged at the verbose level
+        return (event == EV_TX_DELAY_MESSAGE) ? LOG_VERBOSE : LOG_TRACE_CAN_MESSAGES;
+    }
+
+    static void* threadWriterEntryFun(void *arg);
+
+    void writerFun();
+
+    // formats and writes all records which are in the ring,
+    // and returns their number
+    int drainRing(const E_LogRing ring, const int gateway_id);
+
+    // formats one record, and returns the number of characters
+    int formatRecord(const t_log_record& rec, char* buf, const int buf_len) const;
+
+    // converts a record to the capture format, and appends
+    // it to the capture buffer
+    void captureRecord(const t_log_record& rec);
+
+    // appends a record to the capture buffer, and writes
+    // the buffer if it is full
+    void appendCapture(const t_capture_record& crec);
+
+    // appends a session record, which starts
+    // the time stamps at the given time
+    void startCaptureSession(const uint64_t timestamp_ns);
+
+    void flushCapture();
+
+    t_ring rings[NUM_RINGS][MAX_NUM_GATEWAYS];
+
+    pthread_t writer_thread;
+    bool writer_running;
+    std::atomic<bool> exit_writer;
+
+    // text buffer of the writer thread
+    std::vector<char> text_buf;
+
+    // buffer for capture records, which is written
+    // in large blocks
+    std::vector<t_capture_record> capture_buf;
+    int num_captured;
+    uint64_t session_start_ns; // monotonic time of the session start
+
+    // difference between real time and monotonic time
+    // in nanoseconds, measured when the writer is started
+    int64_t realtime_offset_ns;
+
+    // this isn't declared as const because the config is passed
+    // after construction, as for the SBuffer instances
+    EtherCANInterfaceConfig config;
+};
+
+}
+
+}
+#endif
@@ -20,6 +20,7 @@
 #ifndef CAN_COMMAND_H
 #define CAN_COMMAND_H
 
+#include <cassert>
 #include <string.h>
 #include <endian.h>
 #include <time.h>
@@ -76,6 +77,16 @@ public:
 
     virtual ~CAN_Command() {};
 
+    // Instances live in the slabs of the CommandPool, and must be
+    // returned to it by CommandPool::recycleInstance(). The memory
+    // of a deleted instance stays in the slab, but its slot is lost
+    // for good, and provideInstance() blocks forever once the slab
+    // is used up. Debug builds therefore stop at the deletion.
+    static void operator delete(void*)
+    {
+        assert(false && "CAN_Command instance deleted instead of recycled");
+    };
+
 
 
     virtual E_CAN_COMMAND getCANCommandCode()
@@ -154,7 +165,7 @@ public:
 
         // we use bit 7 to 10 for the command code,
         // and bit 0 to 6 for the FPU bus id.
-        assert(fpu_canid <= FPUS_PER_BUS);
+        assert(fpu_canid <= MAX_FPUS_PER_BUS);
 	bcast = _bcast;
         if (! bcast)
         {
@@ -33,14 +33,19 @@ namespace mpifps
 namespace ethercanif
 {
 
-// number of can buses on one gateway (FPU grid layout)
+// number of can buses on one gateway (FPU grid layout). The
+// layout can be changed in the configuration, this is the default.
 const int BUSES_PER_GATEWAY =  5;
 
 // maximum number of can buses on one gateway (ethercan hardware layout)
 const int MAX_BUSES_PER_GATEWAY =  6;
-// number of FPUs on one CAN bus
+// number of FPUs on one CAN bus (default of the configuration)
 const int FPUS_PER_BUS = 76;
 
+// maximum number of FPUs on one CAN bus. The CAN id of an FPU
+// has seven bits, and id zero is used for broadcasts.
+const int MAX_FPUS_PER_BUS = 127;
+
 
 // maximum number of elementary commands resulting from one
 // high-level command
@@ -21,8 +21,8 @@
 #define COMMAND_POOL_H
 
 #include <cassert>
+#include <atomic>
 #include <memory>
-#include <vector>
 
 #include <pthread.h>
 
@@ -44,15 +44,29 @@ class CommandPool
 {
 public:
 
+    // usage statistics for the instances of one command type
+    typedef struct t_pool_stats
+    {
+        int capacity;            // number of allocated instances
+        int num_in_use;          // instances which are currently handed out
+        int high_water_mark;     // maximum of num_in_use since initialize()
+        unsigned long num_waits; // number of times provideInstance() had to wait
+    } t_pool_stats;
+
     explicit CommandPool(const EtherCANInterfaceConfig &config_vals):
         config(config_vals)
     {
     };
 
-    ~CommandPool() {};
+    ~CommandPool()
+    {
+        deInitialize();
+    };
 
     // initializes the pool, allocating
-    // all the required memory for once
+    // all the required memory for once.
+    // Further calls have no effect until
+    // deInitialize() is called.
     E_EtherCANErrCode initialize();
 
 
@@ -64,41 +78,27 @@ public:
     // instance for the given command type.
     // If the pool is temporarily empty, the
     // method blocks until an instance is available.
-    //    template <typename T>
-    //    unique_ptr<T> provideInstance(E_CAN_COMMAND cmd_type);
     //
+    // Each command type has its own slab of instances, so that the
+    // instance is known to have type T, and no dynamic_cast is
+    // needed.
     template<typename T>
     inline unique_ptr<T> provideInstance()
     {
-        unique_ptr<CAN_Command> ptr;
         // get the command code for that class
-        E_CAN_COMMAND cmd_code = T::getCommandCode();
+        const E_CAN_COMMAND cmd_code = T::getCommandCode();
         assert(cmd_code > 0);
         assert(cmd_code < NUM_CAN_COMMANDS);
 
-        pthread_mutex_lock(&pool_mutex);
-        while (pool[cmd_code].empty())
+        CAN_Command* ptr = slabs[cmd_code].pop();
+        if (ptr == nullptr)
         {
-            // wait until a command instance is in the pool
-            // Waiting should almost never happen because
-            // there is a surplus of instances - if
-            // we ever get a dead-lock here, we have a memory
-            // leak of command instances.
-#ifdef DEBUG
-            printf("CommandPool::provideInstance() : waiting for resource\n");
-#endif
-            pthread_cond_wait(&cond_pool_add, &pool_mutex);
+            ptr = waitForInstance(cmd_code);
         }
 
-        ptr = std::move(pool[cmd_code].back());
-        pool[cmd_code].pop_back();
-        pthread_mutex_unlock(&pool_mutex);
-
-        unique_ptr<T> ptrT;
         // if this assert fails, it is a logical error.
-        assert(ptr.get() != nullptr);
-        ptrT.reset(dynamic_cast<T*>(ptr.release()));
-        return ptrT;
+        assert(ptr->getPoolCommandCode() == cmd_code);
+        return unique_ptr<T>(static_cast<T*>(ptr));
     }
 
     // method which recycles an instance that
@@ -107,12 +107,66 @@ public:
     // allocation.
     void recycleInstance(unique_ptr<CAN_Command>& cmdptr);
 
+    // retrieves the usage statistics for one command type
+    void getStatistics(E_CAN_COMMAND cmd_code, t_pool_stats& stats) const;
+
 
 private:
-    typedef std::vector<unique_ptr<CAN_Command>> t_cmdvec;
+
+    // A slab stores all instances of one command class in one
+    // contiguous block of memory. Unused instances are kept in a
+    // lock-free stack, which is linked by slot indices. The top of
+    // the stack holds the index of the first free slot in the lower
+    // 32 bits, and a modification count in the upper 32 bits, which
+    // protects against the ABA problem.
+    class Slab
+    {
+    public:
+        Slab();
+
+        template<typename T> void allocate(int num_instances);
+        void release();
+
+        CAN_Command* pop();
+        void push(CAN_Command* ptr);
+        void getStatistics(t_pool_stats& stats) const;
+
+        std::atomic<unsigned long> num_waits;
+
+    private:
+        static const uint32_t NO_SLOT = 0xffffffffu;
+
+        CAN_Command* instance(uint32_t slot) const
+        {
+            return reinterpret_cast<CAN_Command*>(memory + slot * object_size + base_offset);
+        }
+
+        uint32_t slotIndex(CAN_Command* ptr) const
+        {
+            const size_t offset = reinterpret_cast<char*>(ptr) - base_offset - memory;
+            assert((offset % object_size) == 0);
+            assert((offset / object_size) < capacity);
+            return uint32_t(offset / object_size);
+        }
+
+        char* memory;
+        size_t object_size;
+        ptrdiff_t base_offset; // offset of the CAN_Command base in the instance
+        uint32_t capacity;
+        unique_ptr<std::atomic<uint32_t>[]> next_free;
+        std::atomic<uint64_t> top;
+        std::atomic<uint32_t> num_in_use; // instances which are handed out
+        std::atomic<uint32_t> high_water_mark; // maximum of num_in_use
+    };
+
+    // slow path of provideInstance(), which waits until an
+    // instance is recycled
+    CAN_Command* waitForInstance(E_CAN_COMMAND cmd_code);
 
     const EtherCANInterfaceConfig config;
-    t_cmdvec pool[NUM_CAN_COMMANDS+1]; // numbers are one-based
+    bool initialized = false;
+    Slab slabs[NUM_CAN_COMMANDS+1]; // numbers are one-based
+    std::atomic<int> num_waiting{0}; // threads waiting in waitForInstance()
     pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
     pthread_cond_t cond_pool_add = PTHREAD_COND_INITIALIZER;
 };
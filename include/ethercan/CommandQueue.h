@@ -15,24 +15,32 @@
 // This class implements a thread-safe array of FIFOs for commands to the ethercan
 // layer which can be queried and waited for efficiently
 //
+// The FIFOs are lock-free ring buffers with the TX thread of the
+// gateway as the only consumer. Producers of the same gateway are
+// serialized by a spin lock, which is uncontended in normal
+// operation, because commands are created by the control thread.
+//
+// Each gateway has its own wait flag and event descriptor, so that
+// a separate TX thread per gateway is only woken by its own
+// commands. A single TX thread uses the same descriptor for all
+// gateways.
+//
 ////////////////////////////////////////////////////////////////////////////////
 
 #ifndef  COMMAND_QUEUE_H
 #define COMMAND_QUEUE_H
 
-#include <memory>
-#include <deque>
+#include <atomic>
+#include <pthread.h>
 
 #include "../InterfaceConstants.h"
-#include "CAN_Command.h"
+#include "../InterfaceState.h"
+#include "CommandRecord.h"
 
 #include "../EtherCANInterfaceConfig.h"
 #include "time_utils.h"
-#include "CommandPool.h"
 #include "RingBuffer.h"
-
-
-using std::unique_ptr;
+#include "GridLayout.h"
 
 
 namespace mpifps
@@ -56,67 +64,133 @@ public:
 
     typedef int t_command_mask;
 
+    static const t_command_mask ALL_GATEWAYS = (1 << MAX_NUM_GATEWAYS) - 1;
+
+    // Each gateway has one queue (lane) for each CAN bus, and one
+    // lane for messages to the gateway itself (SYNC commands).
+    // Keeping the buses apart allows the TX thread to interleave
+    // messages to different buses, so that the gateway does not
+    // need to wait for the minimum repeat delay of a bus.
+    // Lanes of buses which are not in the configured layout are
+    // not allocated, and stay empty.
+    static const int GATEWAY_LANE = MAX_BUSES_PER_GATEWAY;
+    static const int NUM_LANES = MAX_BUSES_PER_GATEWAY + 1;
+
+    // interval in which enqueue() checks a full lane again
+    static const int ENQUEUE_BACKOFF_US = 100;
+
     explicit CommandQueue(const EtherCANInterfaceConfig &config_values);
 
-    // set number of active gateways for which queue is polled
+    // set number of active gateways for which queue is polled.
+    // This allocates the lanes of gateways which are not part of
+    // the layout, and must not be called while the TX threads are
+    // running.
     void setNumGateways(int ngws);
 
-    ~CommandQueue() {};
+    ~CommandQueue();
 
-    // initializes the internal data
-    E_EtherCANErrCode initialize();
+    // initializes the internal data, and allocates the lanes
+    // of the gateways which are needed for the layout
+    E_EtherCANErrCode initialize(const GridLayout& grid_layout);
 
 
     // deinitialize, returning internal resources
     E_EtherCANErrCode deInitialize();
 
-    // returns a bitmask indicating which gateway
-    // has pending commands
-    t_command_mask checkForCommand() const;
-
-    // waits until at least one command is available,
-    // and returns bitmask indicating which
-    // gateway has pending commands. If the
-    // waiting time exceeds timeout, an all-zero
-    // mask is returned.
-    t_command_mask waitForCommand(timespec timeout);
-
-    // adds a CAN command to the queue for the corresponding
-    // gateway
-    // This command can fail if the system is out-of memory.
-    E_QueueState enqueue(int gateway_id, unique_ptr<CAN_Command>& new_command);
-
-    unique_ptr<CAN_Command> dequeue(int gateway_id);
-
-
-    // This method adds an entry to the front of the
-    // queue. This is intended for error recovery,
-    // when a command has been dequeued but cannot
-    // be sent, and we don't want to throw away
-    // the command.
-    E_QueueState requeue(int gateway_id, unique_ptr<CAN_Command> new_command);
-
-    // this method empties all queues, flushing
-    // all messages to the memorypool pool of
-    // unused  objects.
+    // returns a bitmask indicating which of the gateways
+    // in gateway_mask has pending commands
+    t_command_mask checkForCommand(t_command_mask gateway_mask=ALL_GATEWAYS) const;
+
+    // Called by the TX thread before it waits for the event
+    // descriptor of the gateways in gateway_mask. The first command
+    // for each of them which is enqueued afterwards signals the
+    // event descriptor, all further commands don't. Returns the
+    // same as checkForCommand(), so that commands which were added
+    // before are not missed.
+    t_command_mask prepareWait(t_command_mask gateway_mask=ALL_GATEWAYS);
+
+    // called by the TX thread after waiting
+    void endWait(t_command_mask gateway_mask=ALL_GATEWAYS);
+
+    // adds a serialized CAN command to the queue for the
+    // corresponding gateway and lane. If the lane is full, this
+    // waits until the TX thread has made room. QS_OUT_OF_MEMORY is
+    // returned, and the command is dropped, if the lane stays full
+    // for longer than the socket time-out. enqueue_us is the time
+    // stamp of enqueueing from latency_timestamp(), which is
+    // returned by dequeue().
+    E_QueueState enqueue(int gateway_id, int lane, const t_command_record& record,
+                         uint32_t enqueue_us=0);
+
+    // returns the number of commands in a lane of a gateway
+    unsigned int getDepth(int gateway_id, int lane) const;
+
+    // returns the number of commands for a gateway for which
+    // enqueue() had to wait because the lane was full
+    unsigned long getNumFullWaits(int gateway_id) const;
+
+    // removes the first command from a lane of a gateway, together
+    // with its time stamp of enqueueing. If the lane is empty, false
+    // is returned.
+    bool dequeue(int gateway_id, int lane, t_command_record& record, uint32_t& enqueue_us);
+
+    // gets information on the first command in each lane of a
+    // gateway, and returns a bitmask of the lanes which are not empty.
+    int getLaneHeads(int gateway_id, t_queue_entry_info heads[NUM_LANES]) const;
+
+
+    // this method empties all queues.
     // The intended use is when an emergency stop
     // needs to be sent, and all queued messages
     // should be discarded.
-    void flushToPool(CommandPool& memory_pool);
+    //
+    // The commands are only marked as discarded. The TX thread
+    // removes them in dropFlushed().
+    void flush();
+
+    // removes flushed commands of a gateway, and returns
+    // their number (called by the TX thread)
+    int dropFlushed(int gateway_id);
 
 
-    void setEventDescriptor(int fd);
+    // sets the event descriptor which is signalled
+    // for new commands to a gateway
+    void setEventDescriptor(int gateway_id, int fd);
 
 private:
     const EtherCANInterfaceConfig config;
     int ngateways;
-    mutable pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-    // condition variables which is signaled on state changes
-    pthread_cond_t cond_queue_append; // is initialized with monotonic clock option
 
-    int EventDescriptorNewCommand;
+    std::atomic<int> EventDescriptorNewCommand[MAX_NUM_GATEWAYS];
+
+    // set while the TX thread of a gateway waits for new commands
+    std::atomic<bool> consumer_waiting[MAX_NUM_GATEWAYS];
+
+    // number of enqueue() calls which found their lane full
+    std::atomic<unsigned long> num_full_waits[MAX_NUM_GATEWAYS];
+
+    // serializes the producers for each gateway. A mutex instead
+    // of a spin lock, because a producer with real-time priority
+    // must not keep a lock holder with lower priority from running.
+    pthread_mutex_t producer_mutex[MAX_NUM_GATEWAYS];
+
+    void lock_producer(int gateway_id);
+    void unlock_producer(int gateway_id);
+
+    void notify_consumer(int gateway_id);
+
+    // sizes the lanes of a gateway for the FPUs on each bus
+    void allocateLanes(int gateway_id);
+
+    GridLayout layout;
+    // number of gateways with allocated lanes
+    int num_allocated;
+
+    RingBuffer fifos[MAX_NUM_GATEWAYS][NUM_LANES];
 
-    RingBuffer fifos[MAX_NUM_GATEWAYS];
+    // running number of enqueued commands for each gateway
+    // (protected by the producer lock)
+    uint64_t ticket_count[MAX_NUM_GATEWAYS];
 
 };
 
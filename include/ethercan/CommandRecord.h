@@ -0,0 +1,149 @@
+// -*- mode: c++ -*-
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME CommandRecord.h
+//
+// This file defines the compact record in which a serialized CAN
+// command is stored in the command queue, and a table with the
+// properties of each command type which the TX thread needs.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef COMMAND_RECORD_H
+#define COMMAND_RECORD_H
+
+#include <cassert>
+#include <string.h>
+
+#include "CAN_Command.h"
+#include "E_CAN_COMMAND.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+// flags of a command record
+enum E_COMMAND_RECORD_FLAGS : uint8_t
+{
+    CRF_BROADCAST        = (1 << 0), // message is sent to all FPUs on a bus
+    CRF_EXPECTS_RESPONSE = (1 << 1), // driver waits for a response
+    CRF_SYNC             = (1 << 2), // gateway SYNC message
+};
+
+// A command which was serialized by the control thread.  The
+// message is complete, except for the sequence number in the first
+// payload byte, which is set by the TX thread when the message is
+// sent.  Records are stored by value in the command queue, so that
+// the TX thread does not need to access the command instances.
+typedef struct __attribute__((packed)) t_command_record
+{
+    uint16_t fpu_id;  // addressed FPU; for broadcasts, any FPU on the bus
+    uint8_t cmd_code; // E_CAN_COMMAND for which a response is expected
+    uint8_t flags;    // E_COMMAND_RECORD_FLAGS
+    uint8_t msg_len;  // number of valid bytes in message
+    t_msg message;    // unencoded message to the gateway
+} t_command_record;
+
+static_assert(sizeof(t_command_record) == 16, "t_command_record should have 16 bytes");
+
+
+// properties of a CAN command type
+typedef struct t_command_properties
+{
+    uint16_t timeout_ms;      // time-out for a response
+    uint16_t sync_timeout_ms; // time-out if sent by a SYNC message
+} t_command_properties;
+
+// These time-outs need to match the values returned by
+// CAN_Command::getTimeOut(), which is checked in makeCommandRecord().
+constexpr t_command_properties COMMAND_PROPERTIES[NUM_CAN_COMMANDS] =
+{
+    /* CCMD_NO_COMMAND                       */ {     0,     0 },
+    /* CCMD_CONFIG_MOTION                    */ { 10000,     0 },
+    /* CCMD_EXECUTE_MOTION                   */ { 60000, 60000 },
+    /* CCMD_ABORT_MOTION                     */ { 10000,  5000 },
+    /* CCMD_LOCK_UNIT                        */ {  1000,     0 },
+    /* CCMD_UNLOCK_UNIT                      */ {  1000,     0 },
+    /* CCMD_READ_REGISTER                    */ { 20500,     0 },
+    /* CCMD_PING_FPU                         */ {  1000,     0 },
+    /* CCMD_RESET_FPU                        */ {  5000,     0 },
+    /* CCMD_FIND_DATUM                       */ { 60000,     0 },
+    /* CCMD_RESET_STEPCOUNTER                */ {  1000,     0 },
+    /* CCMD_REPEAT_MOTION                    */ {  1000,     0 },
+    /* CCMD_REVERSE_MOTION                   */ {  1000,     0 },
+    /* CCMD_ENABLE_BETA_COLLISION_PROTECTION */ {  5000,     0 },
+    /* CCMD_FREE_BETA_COLLISION              */ {  5000,     0 },
+    /* CCMD_SET_USTEP_LEVEL                  */ { 10000,     0 },
+    /* CCMD_GET_FIRMWARE_VERSION             */ {  1000,     0 },
+    /* CCMD_CHECK_INTEGRITY                  */ { 30000,     0 },
+    /* CCMD_FREE_ALPHA_LIMIT_BREACH          */ {  5000,     0 },
+    /* CCMD_ENABLE_ALPHA_LIMIT_PROTECTION    */ {  1000,     0 },
+    /* CCMD_SET_TICKS_PER_SEGMENT            */ {  1000,     0 },
+    /* CCMD_SET_STEPS_PER_SEGMENT            */ {  1000,     0 },
+    /* CCMD_ENABLE_MOVE                      */ {  5000,     0 },
+    /* CCMD_READ_SERIAL_NUMBER               */ {  1000,     0 },
+    /* CCMD_WRITE_SERIAL_NUMBER              */ { 15000,     0 },
+    /* CCMD_SYNC_COMMAND                     */ {     0,     0 },
+};
+
+
+// time-out for the response to a command record
+inline timespec getRecordTimeOut(const t_command_record& record)
+{
+    const t_command_properties& props = COMMAND_PROPERTIES[record.cmd_code];
+    const int ms = (record.flags & CRF_SYNC) ? props.sync_timeout_ms : props.timeout_ms;
+
+    timespec const toval =
+    {
+        /* .tv_sec = */ ms / 1000,
+        /* .tv_nsec = */ (ms % 1000) * 1000000
+    };
+    return toval;
+}
+
+
+// Serializes a parametrized command into a record. The busid and
+// CAN id are those of the FPU the command is sent to.
+inline void makeCommandRecord(CAN_Command& command, const int fpu_id,
+                              const uint8_t busid, const uint8_t fpu_canid,
+                              t_command_record& record)
+{
+    t_CAN_buffer can_buffer;
+    int msg_len = 0;
+
+    // the sequence number is set when the message is sent
+    command.SerializeToBuffer(busid, fpu_canid, msg_len, can_buffer, 0);
+    assert(msg_len <= int(sizeof(t_msg)));
+
+    record.fpu_id = fpu_id;
+    record.cmd_code = command.getCANCommandCode();
+    record.flags = ((command.doBroadcast() ? CRF_BROADCAST : 0)
+                    | (command.expectsResponse() ? CRF_EXPECTS_RESPONSE : 0)
+                    | (command.doSync() ? CRF_SYNC : 0));
+    record.msg_len = msg_len;
+    memcpy(&record.message, &can_buffer.message, sizeof(t_msg));
+
+    assert(record.cmd_code < NUM_CAN_COMMANDS);
+#ifndef NDEBUG
+    const timespec cmd_timeout = command.getTimeOut();
+    const timespec record_timeout = getRecordTimeOut(record);
+    assert((cmd_timeout.tv_sec == record_timeout.tv_sec)
+           && (cmd_timeout.tv_nsec == record_timeout.tv_nsec));
+#endif
+}
+
+}
+
+}
+#endif
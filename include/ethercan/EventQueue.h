@@ -0,0 +1,159 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME EventQueue.h
+//
+// Compact events which describe the change of the state of one FPU,
+// and a bounded lock-free queue which delivers them from the RX
+// thread to one subscriber.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <time.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+enum E_FPU_EVENT_TYPE
+{
+    FE_RESPONSE = 1, // a response or message of the FPU was processed
+    FE_TIMEOUT  = 2, // a command to the FPU has timed out
+};
+
+typedef struct t_fpu_event
+{
+    timespec timestamp;   // time of the response or time-out (monotonic clock)
+    uint32_t sequence;    // running number in the subscription; a gap
+                          // means that events were dropped
+    int16_t fpu_id;
+    uint8_t event_type;   // E_FPU_EVENT_TYPE
+    uint8_t cmd_code;     // E_CAN_COMMAND of the response, or of the
+                          // command which timed out
+    uint8_t old_state;    // E_FPU_STATE before the event
+    uint8_t new_state;    // E_FPU_STATE after the event
+    uint8_t flags;        // E_HOT_FLAGS after the event (see GridHotState.h)
+    uint8_t last_status;  // E_MOC_ERRCODE after the event
+    int32_t alpha_steps;
+    int32_t beta_steps;
+} t_fpu_event;
+
+
+// The queue has a single producer, which is the thread holding the
+// grid state lock of the FPUArray, and a single consumer, which is
+// the thread reading the subscription. When the queue is full, new
+// events are dropped and counted. An eventfd descriptor becomes
+// readable when events arrive while the consumer has found the
+// queue empty, so that it can be polled together with other
+// descriptors.
+class EventQueue
+{
+public:
+
+    static const int CAPACITY = 4096;
+
+    EventQueue();
+    ~EventQueue();
+
+    // returns false if the event descriptor could not be created
+    bool isValid() const
+    {
+        return event_fd >= 0;
+    }
+
+    int getDescriptor() const
+    {
+        return event_fd;
+    }
+
+    // adds an event, or drops it if the queue is full
+    // (called by the producer)
+    void push(t_fpu_event& event)
+    {
+        event.sequence = sequence++;
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        if ((h - cached_tail) >= uint64_t(CAPACITY))
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if ((h - cached_tail) >= uint64_t(CAPACITY))
+            {
+                num_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        slots[h % CAPACITY] = event;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // signals the event descriptor if the consumer waits for
+    // events (called by the producer after a batch of push() calls)
+    void notify();
+
+    // removes up to max_events events, and returns their number
+    // (called by the consumer). If the queue is empty, the consumer
+    // is marked as waiting, so that the next event signals the
+    // descriptor.
+    int pop(t_fpu_event* events, int max_events);
+
+    // waits until events are available or max_wait_time seconds
+    // have passed, and returns true in the first case
+    // (called by the consumer)
+    bool wait(double max_wait_time);
+
+    // number of events which were dropped because the queue was full
+    unsigned long getNumDropped() const
+    {
+        return num_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    bool empty() const
+    {
+        return (tail.load(std::memory_order_relaxed)
+                == head.load(std::memory_order_acquire));
+    }
+
+    // marks the consumer as waiting, and returns false if the
+    // queue is not empty any more (called by the consumer)
+    bool prepareWait();
+
+    std::vector<t_fpu_event> slots;
+    int event_fd;
+
+    // (padding is used as in RingBuffer.h)
+    char pad0[64];
+    std::atomic<uint64_t> head;
+    uint64_t cached_tail; // last tail value seen by the producer
+    uint32_t sequence;
+    std::atomic<unsigned long> num_dropped;
+    char pad1[64];
+    std::atomic<uint64_t> tail;
+    std::atomic<bool> consumer_waiting;
+    bool armed; // the consumer has set consumer_waiting since the last read of event_fd
+    char pad2[64];
+};
+
+}
+
+}
+
+#endif
@@ -24,6 +24,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <atomic>
+#include <vector>
 #include <string.h>		/// memset()
 
 #include "../E_GridState.h"
@@ -34,6 +35,10 @@
 #include "../EtherCANInterfaceConfig.h"
 #include "TimeOutList.h"
 #include "CAN_Command.h"
+#include "GridHotState.h"
+#include "GridLayout.h"
+#include "LatencyHistogram.h"
+#include "EventQueue.h"
 
 /* Switches on use of monotonic clock for timed waits
    on grid state changes. This is advisable to avoid
@@ -59,25 +64,16 @@ public:
     // a response
     static const timespec MAX_TIMEOUT;
 
-    typedef struct
-    {
-        uint8_t gateway_id;
-        uint8_t bus_id;
-        uint8_t can_id;
-    } t_bus_address;
-
-    typedef t_bus_address  t_bus_address_map[MAX_NUM_POSITIONERS];
-
-    // translation table to convert FPU ids in CAN addresses.
-    // for the can bus ID, the index 0 is not used
-    typedef uint16_t t_address_map[MAX_NUM_GATEWAYS][BUSES_PER_GATEWAY][1 + FPUS_PER_BUS];
+    // set of FPUs (same as AsyncInterface::t_fpuset)
+    typedef bool t_fpuset[MAX_NUM_POSITIONERS];
 
 
     explicit FPUArray(const EtherCANInterfaceConfig &config_vals);
 
     ~FPUArray();
 
-    // initialize internal structures
+    // initialize internal structures, which are sized
+    // for the configured number of FPUs
     E_EtherCANErrCode initialize();
 
     // deinitialize internal structures
@@ -86,8 +82,34 @@ public:
     // this method retrieves the current grid state for all FPUs
     // (including collision states etc). It does not wait for
     // completion of commands, and can be called concurrently..
+    //
+    // The state is read as a consistent snapshot without taking the
+    // grid state lock, so that the I/O threads are not blocked while
+    // it is copied.
     E_GridState getGridState(t_grid_state& out_state) const;
 
+    // like getGridState(), but only copies the state of the FPUs
+    // in fpuset, and the grid-wide counters. The entries for other
+    // FPUs in out_state are not changed.
+    E_GridState getGridStateSubset(t_grid_state& out_state, const t_fpuset& fpuset) const;
+
+    // only copies the grid-wide counters and the interface
+    // state, leaving out_state.FPU_state unchanged.
+    E_GridState getGridCounters(t_grid_state& out_state) const;
+
+    // copies the frequently scanned members of the FPU states,
+    // which are much smaller than the full grid state.
+    void getHotState(t_grid_hot_state& out_state) const;
+
+    // counts the current states of the FPUs in fpuset. This scans
+    // only the state array, without copying the grid state.
+    void countStates(const t_fpuset& fpuset, t_counts& counts) const;
+
+    // returns the number of FPUs which are moving or have a pending
+    // or queued command, plus the FPUs in fpuset which are ready
+    // to move, from one consistent snapshot.
+    int countMoving(const t_fpuset& fpuset) const;
+
     // returns summary state of FPU grid
     E_GridState getStateSummary() const;
 
@@ -124,30 +146,38 @@ public:
     // queries whether an FPU is locked.
     bool isLocked(int fpu_id) const;
 
-    // sets pending command for one FPU.
-    void setPendingCommand(int fpu_id, E_CAN_COMMAND pending_cmd, timespec tout_val,
+    // sets pending command for one FPU. send_time is the
+    // monotonic time at which the command is sent.
+    void setPendingCommand(int fpu_id, E_CAN_COMMAND pending_cmd,
+                           const timespec& send_time, timespec tout_val,
                            uint8_t sequence_number, TimeOutList& timeout_list);
 
 
     // sets last command for a FPU.
     void setLastCommand(int fpu_id, E_CAN_COMMAND last_cmd);
 
+    // removes a pending command of one FPU which was discarded
+    // by abortMotion() before it was sent, and cancels its time-out
+    void cancelPendingCommand(int fpu_id, E_CAN_COMMAND pending_cmd,
+                              TimeOutList& timeout_list);
+
     // updates state for all FPUs which did
     // not respond in time, popping their time-out entries
     // from the list. tolist must not be locked.
     void processTimeouts(timespec cur_time, TimeOutList& tolist);
 
     // parses and dispatches an incoming CAN response to update the
-    // state of the FPU grid. The first parameter is the mapping from
-    // CAN IDs to fpu_ids. Timeouts are cleared.  Any relevant status
-    // change of the grid will be signalled via the condition
-    // variable.
-    void dispatchResponse(const t_address_map& fpu_id_by_adr,
+    // state of the FPU grid. The first parameter provides the mapping
+    // from CAN IDs to fpu_ids. Timeouts are cleared.  Any relevant
+    // status change of the grid will be signalled via the condition
+    // variable. cur_time is the monotonic time of reception.
+    void dispatchResponse(const GridLayout& layout,
                           const int gateway_id,
                           const uint8_t busid,
                           const uint16_t canid,
                           const t_response_buf& data,
                           const int blen,
+                          const timespec& cur_time,
                           TimeOutList& timeOutList);
 
 
@@ -158,9 +188,10 @@ public:
 
 
     // increment and decrement number of commands
-    // which are currently sent.
-    void incSending();
-    void decSending();
+    // which are currently sent. These do not take the
+    // grid state lock, except when the count drops to zero.
+    void incSending(unsigned int count=1);
+    void decSending(unsigned int count=1);
 
     // increments and fetches the next message sequence number
     // for this FPU
@@ -170,6 +201,51 @@ public:
     // get number of commands which are being sent.
     int  countSending() const;
 
+    // latency histograms of the command life cycle. The send and
+    // response times, and the wakeup of waitForState(), are
+    // recorded by the FPUArray itself.
+    void recordLatency(const E_LATENCY_METRIC metric, const E_CAN_COMMAND cmd_code,
+                       const int64_t value)
+    {
+        latency_stats.record(metric, cmd_code, value);
+    }
+
+    void getLatencyHistogram(const E_LATENCY_METRIC metric, const E_CAN_COMMAND cmd_code,
+                             t_latency_histogram& out_histogram) const
+    {
+        latency_stats.getHistogram(metric, cmd_code, out_histogram);
+    }
+
+    void resetLatencyHistograms()
+    {
+        latency_stats.reset();
+    }
+
+    // Subscriptions to the state change events of the FPUs (see
+    // EventQueue.h), which are published by the thread that
+    // processes responses and time-outs. A subscription must only
+    // be read and cancelled by one thread at a time.
+    static const int MAX_EVENT_SUBSCRIPTIONS = 8;
+
+    E_EtherCANErrCode subscribeEvents(int& subscription_id);
+
+    E_EtherCANErrCode unsubscribeEvents(const int subscription_id);
+
+    // Reads up to max_events events. If none are available, waits
+    // up to max_wait_time seconds (or without limit, if it is
+    // negative).
+    E_EtherCANErrCode readEvents(const int subscription_id, t_fpu_event* events,
+                                 const int max_events, int& num_events,
+                                 const double max_wait_time);
+
+    // descriptor which becomes readable when events are available
+    // after readEvents() has returned all events, or -1
+    int getEventDescriptor(const int subscription_id) const;
+
+    // number of events which were dropped because the
+    // subscriber did not read them in time
+    unsigned long getNumDroppedEvents(const int subscription_id) const;
+
 private:
 
 
@@ -188,6 +264,79 @@ private:
     // lock protection.
     E_GridState getStateSummary_unprotected() const;
 
+    // Writers of FPUGridState hold the grid_state_mutex, and
+    // enclose each change in beginUpdate() and endUpdate(), which
+    // increment state_version. Readers copy the state without the
+    // lock, and repeat the copy if the version was odd or has
+    // changed in the meantime (a sequence lock).
+    void beginUpdate();
+    void endUpdate();
+
+    // signals a state change to the waitForState() callers whose
+    // target was reached. cause is the command which was completed
+    // by a response received at time_us, or CCMD_NO_COMMAND for
+    // other changes. Must be called with the grid_state_mutex held.
+    void signalStateChange(const E_CAN_COMMAND cause, const uint32_t time_us);
+
+    // A thread in waitForState() registers its target in a waiter
+    // slot, and sleeps on the condition variable of that slot.
+    // When the grid state changes, signalStateChange() evaluates
+    // the targets of the registered waiters from the grid-wide
+    // counters, and only wakes the waiters whose target was
+    // reached. For GS_ALL_UPDATED, each waiter counts the FPUs
+    // which were not updated yet, and fpu_waiters holds for each
+    // FPU the waiters which wait for it, so that a response only
+    // touches the waiters which need it. If all slots are taken,
+    // further waiters use cond_state_change, which is broadcast on
+    // every signal.
+    static const int MAX_WAITERS = 32;
+
+    typedef struct t_waiter
+    {
+        pthread_cond_t cond;
+        E_WaitTarget target;
+        unsigned long count_timeout;          // counters when the wait started
+        unsigned long count_can_overflow;
+        const timespec* reference_timestamps; // for GS_ALL_UPDATED
+        int num_not_updated;                  // FPUs which were not updated yet
+        bool signalled;                       // cond was signalled since the last wait
+        E_CAN_COMMAND signal_cause;           // arguments of the signal
+        uint32_t signal_us;
+    } t_waiter;
+
+    // returns the slot of a new waiter, or -1 if all are taken
+    int registerWaiter(E_WaitTarget target, unsigned long count_timeout,
+                       unsigned long count_can_overflow,
+                       const timespec* reference_timestamps) const;
+
+    void unregisterWaiter(int slot) const;
+
+    // returns true if the wait of a registered waiter has ended
+    bool waiterReady(const t_waiter& waiter, E_GridState sum_state) const;
+
+    // updates the waiters for GS_ALL_UPDATED after a response of
+    // an FPU, and returns true if any of them has become ready
+    bool checkFPUUpdated(const int fpu_id);
+
+    // adds an event for an FPU to all subscriptions. Must be
+    // called with the grid_state_mutex held, and followed by
+    // notifySubscribers().
+    void publishEvent(const E_FPU_EVENT_TYPE event_type, const int fpu_id,
+                      const uint8_t cmd_code, const E_FPU_STATE old_state,
+                      const timespec& timestamp);
+
+    void notifySubscribers();
+
+    // returns the queue of a subscription, or nullptr
+    EventQueue* getEventQueue(const int subscription_id) const;
+
+    // calls copy_state() to read a consistent snapshot of
+    // FPUGridState. After MAX_SNAPSHOT_RETRIES failed attempts,
+    // it takes the lock.
+    template<typename F> void readSnapshot(F copy_state) const;
+
+    static const int MAX_SNAPSHOT_RETRIES = 8;
+
 
     // This internal function returns true if the
     // grid is in the requested state.
@@ -203,6 +352,14 @@ private:
 
     // structures which describe the current state of the whole grid
     t_grid_state FPUGridState;
+    // copy of the frequently scanned members of FPUGridState,
+    // which is kept up to date when an FPU state is changed
+    t_grid_hot_state hot_state;
+    // version number of FPUGridState, which is odd during changes
+    std::atomic<unsigned long> state_version;
+    // number of queued commands. This is copied into
+    // FPUGridState.num_queued when the state is retrieved.
+    std::atomic<unsigned int> num_queued;
     // this mutex protects the FPU state array structure
     mutable pthread_mutex_t grid_state_mutex = PTHREAD_MUTEX_INITIALIZER;
     // condition variables which is signaled on state changes
@@ -211,6 +368,27 @@ private:
 #else
     mutable pthread_cond_t cond_state_change = PTHREAD_COND_INITIALIZER;
 #endif
+
+    // time stamps at which the pending commands of each FPU
+    // were sent (indexed by fpu_id * NUM_CAN_COMMANDS + cmd_code),
+    // and the cause and time of the last signal of
+    // cond_state_change (protected by grid_state_mutex)
+    std::vector<uint32_t> send_time_us;
+    unsigned long signal_count;
+    E_CAN_COMMAND last_signal_cause;
+    uint32_t last_signal_us;
+
+    // registered waiters (protected by grid_state_mutex)
+    mutable t_waiter waiters[MAX_WAITERS];
+    mutable uint32_t active_waiters; // bit mask of used slots
+    mutable std::vector<uint32_t> fpu_waiters;
+    mutable int num_overflow_waiters; // waiters on cond_state_change
+
+    // event subscriptions (changed while holding grid_state_mutex)
+    std::atomic<EventQueue*> event_queues[MAX_EVENT_SUBSCRIPTIONS];
+    uint32_t active_subscriptions; // bit mask of used entries
+
+    mutable LatencyStats latency_stats;
 };
 
 
@@ -221,8 +399,8 @@ void add_pending(t_fpu_state& fpu, int fpu_id, E_CAN_COMMAND cmd_code,
                  unsigned int &count_pending,
                  const uint8_t sequence_number);
 
-// remove a command from the pending command set, and refresh the
-// time-out list with the next time out.
+// remove a command from the pending command set, and cancel
+// its time-out.
 void remove_pending(const EtherCANInterfaceConfig &config,
                     t_fpu_state& fpu, int fpu_id,
                     E_CAN_COMMAND cmd_code, E_MOC_ERRCODE cmd_status,
@@ -230,21 +408,17 @@ void remove_pending(const EtherCANInterfaceConfig &config,
                     unsigned int &count_pending,
                     uint8_t msg_sequence_number);
 
-// Remove time out entries which are earlier than the expiration time
-// from the fpu pending set, and return the next time-out value from
-// the remaining set (or MAX_TIMESPEC if the set is empty)
-timespec expire_pending(const EtherCANInterfaceConfig &config,
-                        t_fpu_state& fpu, int fpu_id, const timespec& expiration_time,
-                        unsigned int  &count_pending, unsigned long &count_timeouts);
-
-
-
-// helper functions
-bool check_all_fpus_updated(int num_fpus,
-                            t_grid_state& old_grid_state,
-                            const t_grid_state& grid_state);
-
-timespec get_min_pending(const t_fpu_state& fpu);
+// Remove a command which has timed out from the fpu pending set,
+// and update the FPU state accordingly.
+void expire_pending(const EtherCANInterfaceConfig &config,
+                    t_fpu_state& fpu, int fpu_id, const E_CAN_COMMAND cmd_code,
+                    unsigned int &count_pending, unsigned long &count_timeouts);
+
+// Remove a command which was discarded before it was sent from the
+// pending set, and cancel its time-out. The FPU state and the last
+// command are not changed, because the FPU never received it.
+void cancel_pending(t_fpu_state& fpu, int fpu_id, const E_CAN_COMMAND cmd_code,
+                    TimeOutList& timeout_list, unsigned int &count_pending);
 
 }
 
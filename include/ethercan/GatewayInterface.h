@@ -36,6 +36,8 @@
 #include "TimeOutList.h"
 #include "CommandQueue.h"
 #include "CommandPool.h"
+#include "IOStatistics.h"
+#include "RealTimeStatus.h"
 #include "ethercan/cancommandsv2/SyncCommand.h"
 
 namespace mpifps
@@ -53,11 +55,6 @@ class GatewayInterface: private I_ResponseHandler
 {
 public:
 
-    // timeout for reading from command FIFO if nothing is
-    // pending - 500 ms
-    const struct timespec COMMAND_WAIT_TIME = { /* .tv_sec = */ 0,
-              /* .tv_nsec = */ 10000000
-    };
     // timeout for polling write socket - 500 ms
     const struct timespec MAX_TX_TIMEOUT = { /* .tv_sec = */ 0,
               /* .tv_nsec = */ 500000000
@@ -93,6 +90,23 @@ public:
     // is stored in the reference parameter
     E_GridState getGridState(t_grid_state& out_state) const;
 
+    // get the state of a subset of FPUs, and the grid-wide counters
+    E_GridState getGridStateSubset(t_grid_state& out_state,
+                                   const FPUArray::t_fpuset& fpuset) const;
+
+    // get only the grid-wide counters and the interface state
+    E_GridState getGridCounters(t_grid_state& out_state) const;
+
+    // get the frequently scanned members of the FPU states
+    void getHotState(t_grid_hot_state& out_state) const;
+
+    // count the current states of the FPUs in fpuset
+    void countStates(const FPUArray::t_fpuset& fpuset, t_counts& counts) const;
+
+    // count the FPUs which are moving, have a pending or queued
+    // command, or are in fpuset and ready to move
+    int countMoving(const FPUArray::t_fpuset& fpuset) const;
+
     // get the current state of the driver (this is a convenience
     // function, the state is contained in the grid state).
     E_InterfaceState getInterfaceState() const;
@@ -113,9 +127,72 @@ public:
         return command_pool.provideInstance<T>();
     }
 
-    void updatePendingSets(unique_ptr<CAN_Command> &active_can_command,
+    // usage statistics of the command pool for one command type
+    void getCommandPoolStats(E_CAN_COMMAND cmd_code, CommandPool::t_pool_stats& stats) const
+    {
+        command_pool.getStatistics(cmd_code, stats);
+    }
+
+    // latency histograms of the command life cycle
+    // (see LatencyHistogram.h)
+    void getLatencyHistogram(const E_LATENCY_METRIC metric, const E_CAN_COMMAND cmd_code,
+                             t_latency_histogram& out_histogram) const
+    {
+        fpuArray.getLatencyHistogram(metric, cmd_code, out_histogram);
+    }
+
+    void resetLatencyHistograms()
+    {
+        fpuArray.resetLatencyHistograms();
+    }
+
+    // subscriptions to FPU state change events
+    // (see EventQueue.h)
+    E_EtherCANErrCode subscribeEvents(int& subscription_id)
+    {
+        return fpuArray.subscribeEvents(subscription_id);
+    }
+
+    E_EtherCANErrCode unsubscribeEvents(const int subscription_id)
+    {
+        return fpuArray.unsubscribeEvents(subscription_id);
+    }
+
+    E_EtherCANErrCode readEvents(const int subscription_id, t_fpu_event* events,
+                                 const int max_events, int& num_events,
+                                 const double max_wait_time)
+    {
+        return fpuArray.readEvents(subscription_id, events, max_events, num_events,
+                                   max_wait_time);
+    }
+
+    int getEventDescriptor(const int subscription_id) const
+    {
+        return fpuArray.getEventDescriptor(subscription_id);
+    }
+
+    unsigned long getNumDroppedEvents(const int subscription_id) const
+    {
+        return fpuArray.getNumDroppedEvents(subscription_id);
+    }
+
+    // counters of the socket and CAN bus traffic
+    // (see IOStatistics.h)
+    void getIOStatistics(t_io_stats& out_stats) const;
+
+    // result of the self-check of the real-time profile
+    // (see RealTimeStatus.h)
+    void getRealTimeStatus(t_rt_status& out_status) const;
+
+    void updatePendingSets(const t_command_record& record,
+                           const uint8_t sequence_number,
+                           const timespec& send_time,
                            int gateway_id, int busid);
 
+    // reverts updatePendingSets() for a command which was
+    // discarded from the write buffer before it was sent
+    void cancelPendingSets(const t_command_record& record, int gateway_id);
+
 
     // send a CAN command to the gateway.
     // This method is thread-safe
@@ -132,6 +209,14 @@ public:
     // returns whether an FPU is currently marked as locked.
     bool isLocked(int fpu_id) const;
 
+    // returns the total time in milliseconds which the gateways
+    // were instructed to wait by inserted delay messages.
+    unsigned long getInsertedDelayMs() const;
+
+    // returns the number of CAN trace log records which were
+    // dropped because the log writer could not keep up.
+    unsigned long getNumDroppedLogRecords() const;
+
 
 
 
@@ -140,6 +225,12 @@ public:
     // (This is implemented at the CAN driver level because we need
     // the Rx thread to be able to trigger an automatic abort if too
     // many collisions happen in a short time span.).
+    //
+    // The abort messages do not go through the command queue. They
+    // are prepared when the driver connects, and the TX thread is
+    // woken by a separate event descriptor and inserts them into the
+    // write buffer of each gateway right after the frame which it is
+    // currently sending, in front of any other unsent messages.
     E_EtherCANErrCode abortMotion(t_grid_state& grid_state,
                                   E_GridState& state_summary,
 				  bool sync_message=true);
@@ -179,7 +270,7 @@ public:
 
 	    for (int gateway_id=0; gateway_id < num_gateways; gateway_id++)
 	    {
-		for(int busid=0; busid < BUSES_PER_GATEWAY; busid++)
+		for(int busid=0; busid < layout.getBusesPerGateway(); busid++)
 		{
 		    const int broadcast_id = getBroadcastID(gateway_id, busid);
 		    if (broadcast_id >= config.num_fpus)
@@ -206,10 +297,23 @@ Exit:
     }
 
 
-    // the following two methods are actually internal -
+    // the following methods are actually internal -
     // they need to be visible in a non-member function.
+    //
+    // threadTxFun() and threadRxFun() serve all gateways, the
+    // other two only one gateway, if config.io_thread_per_gateway
+    // is set.
     void* threadTxFun();
     void* threadRxFun();
+    void* threadGatewayTxFun(const int gateway_id);
+    void* threadGatewayRxFun(const int gateway_id);
+
+    // argument of the thread entry functions
+    typedef struct t_io_thread_arg
+    {
+        GatewayInterface* driver;
+        int gateway_id; // -1 if the thread serves all gateways
+    } t_io_thread_arg;
 
 
 private:
@@ -238,31 +342,130 @@ private:
     int num_gateways = 0;
     // socket descriptor
     int SocketID[MAX_NUM_GATEWAYS];
-    int DescriptorCommandEvent; // eventfd for new command
+    // The event descriptors for new commands and for abortMotion()
+    // exist for each TX thread, and are indexed like tx_threads.
+    int DescriptorCommandEvent[MAX_NUM_GATEWAYS]; // eventfd for new command
     int DescriptorCloseEvent;  // eventfd for closing connection
+    int DescriptorAbortEvent[MAX_NUM_GATEWAYS];  // eventfd for abortMotion()
+
+    // creates the event descriptors, and returns false
+    // if that fails
+    bool open_event_descriptors(const int num_threads);
+
+    // closes those event descriptors which are open
+    void close_event_descriptors();
+
+    // index of the TX and RX threads which serve a gateway
+    int io_thread_of_gateway(const int gateway_id) const
+    {
+        return config.io_thread_per_gateway ? gateway_id : 0;
+    }
+
+    // starts the TX and RX threads, and returns
+    // DE_ASSERTION_FAILED if that fails
+    E_EtherCANErrCode start_io_threads(const int num_threads);
+
+    CommandPool command_pool; // memory pool for unused command objects
 
     CommandQueue commandQueue;
 
 
-    // send a buffer (either pending data or new command)
-    SBuffer::E_SocketStatus send_buffer(unique_ptr<CAN_Command> &active_can_command,
-                                        int gateway_id);
+    // send a buffer (either pending data or a new batch of commands)
+    SBuffer::E_SocketStatus send_buffer(int gateway_id);
+
+    // Busy polling of the I/O threads (see
+    // EtherCANInterfaceConfig::busy_poll). Both methods serve the
+    // gateways from first_gateway up to end_gateway, and spin until
+    // config.busy_poll_budget_us have passed without any traffic.
+    //
+    // spin_tx() returns true as soon as a command or an abort
+    // request is pending, so that the TX thread sends it without
+    // waiting for the event descriptors.
+    bool spin_tx(int first_gateway, int end_gateway);
+
+    // spin_rx() reads and processes responses with non-blocking
+    // recv() calls as they arrive, and processes due time-outs. It
+    // returns false if reading from a socket failed.
+    bool spin_rx(int first_gateway, int end_gateway);
+
+    // applies the configured CPU affinity and real-time priority to
+    // the calling I/O thread, pre-faults its stack if memory is
+    // locked, and reports the result to the self-check of connect()
+    void setup_io_thread(t_rt_thread_status& thread_status, int cpu, int prio);
+
+    // waits until all I/O threads have reported their settings,
+    // and logs which of the requested guarantees were obtained
+    void check_rt_profile(int num_threads);
+
+    // sets the sequence number of a dequeued command record, and
+    // updates the pending sets of the addressed FPUs
+    void prepare_record(const t_command_record& record, const timespec& send_time,
+                        int gateway_id, t_CAN_buffer& can_buffer, int& busid, int& canid);
+
+    // prepares the abort messages for each gateway
+    void init_abort_records(int ngateways);
+
+    // inserts the requested abort messages into the write
+    // buffer of a gateway, and discards the commands which
+    // follow them (called by the TX thread)
+    void insert_abort(int gateway_id);
+
+    // records the latency of the abort messages once they
+    // are written to the socket (called by the TX thread)
+    void check_abort_sent(int gateway_id);
+
+    // abort requests for a gateway
+    enum E_ABORT_REQUEST
+    {
+        AR_NONE      = 0,
+        AR_BROADCAST = 1, // broadcast to each bus of the gateway
+        AR_SYNC      = 2, // SYNC message (only to gateway 0)
+    };
+
+    // number of messages which an abort request needs
+    int num_abort_messages(int gateway_id, int request) const
+    {
+        return (request == AR_SYNC) ? 1 : ((request == AR_BROADCAST)
+                                           ? num_abort_records[gateway_id] : 0);
+    }
+
+    // selects the command queue lane from which the next command
+    // for a gateway is sent, or returns -1 if all lanes are empty.
+    int select_lane(int gateway_id);
+
+    // updates the interface state after a send error of
+    // a TX thread (called by the TX threads)
+    void handle_send_error(const SBuffer::E_SocketStatus status);
+
+    // logs a read error of an RX thread
+    void log_read_error(const SBuffer::E_SocketStatus status);
+
+    // sets the exit flag, and wakes up all I/O threads
+    // so that they terminate
+    void signal_exit();
 
     // interface method which handles decoded CAN response messages
     virtual void handleFrame(int const gateway_id, const t_CAN_buffer& command_buffer, int const clen);
 
 
     void updatePendingCommand(int fpu_id,
-                              std::unique_ptr<CAN_Command>& can_command);
+                              const t_command_record& record,
+                              const timespec& send_time,
+                              const timespec& deadline,
+                              const uint8_t sequence_number);
 
 
 
     // read buffer (only to be accessed in reading thread)
     // write buffer (only to be accessed in writing thread)
 
-    // two POSIX threads for sending and receiving data
-    pthread_t    tx_thread;
-    pthread_t    rx_thread;
+    // POSIX threads for sending and receiving data, either one
+    // pair for all gateways, or one pair for each gateway
+    pthread_t    tx_threads[MAX_NUM_GATEWAYS];
+    pthread_t    rx_threads[MAX_NUM_GATEWAYS];
+    int num_io_threads; // number of TX threads, which is
+                        // the same as the number of RX threads
+    t_io_thread_arg io_thread_args[MAX_NUM_GATEWAYS];
     // this atomic flag serves to signal both threads to exit
     std::atomic<bool> exit_threads;
     // this flag informs that a driver shutdown is in progress
@@ -274,20 +477,57 @@ private:
     // buffer class for encoded reads and writes to sockets
     SBuffer sbuffer[MAX_NUM_GATEWAYS];
 
-    // mapping of FPU IDs to physical addresses.
-    // (can be made configurable if required)
-    FPUArray::t_bus_address_map  address_map;
+    // commands in the current batch of each write buffer, in the
+    // order of sending, so that their pending sets can be reverted
+    // if an abort discards them (only accessed by the TX thread)
+    std::vector<t_command_record> batch_records[MAX_NUM_GATEWAYS];
+
+    // trace log of sent and received CAN messages, which
+    // is written by a background thread
+    CANLog can_log;
+
+    // traffic counters of the TX and RX threads
+    IOStatistics io_stats;
+
+    // obtained real-time guarantees, and the number of I/O threads
+    // which have reported theirs since connect(). The mutex protects
+    // the thread entries, which the I/O threads write.
+    t_rt_status rt_status;
+    int num_rt_reports;
+    mutable pthread_mutex_t rt_status_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    // lane (CAN bus) of the last command sent to each
+    // gateway, used for round-robin scheduling
+    int last_lane[MAX_NUM_GATEWAYS];
 
-    // reverse map of addresses to FPU id.
-    FPUArray::t_address_map fpu_id_by_adr; // address map from can bus addresses to fpu id
+    // pending abort request for each gateway (E_ABORT_REQUEST),
+    // and the time stamp of the request (see latency_timestamp())
+    std::atomic<int> abort_request[MAX_NUM_GATEWAYS];
+    std::atomic<uint32_t> abort_request_us[MAX_NUM_GATEWAYS];
+
+    // abort messages, serialized when the driver connects
+    t_command_record abort_records[MAX_NUM_GATEWAYS][MAX_BUSES_PER_GATEWAY];
+    int num_abort_records[MAX_NUM_GATEWAYS];
+    t_command_record sync_abort_record;
+
+    // time stamp of the request whose abort messages are in the
+    // write buffer (only accessed by the TX thread)
+    uint32_t abort_sending_us[MAX_NUM_GATEWAYS];
+    bool abort_sending[MAX_NUM_GATEWAYS];
+
+    // mapping of FPU IDs to physical addresses and back,
+    // set up from the configuration in initialize()
+    GridLayout layout;
 
     const EtherCANInterfaceConfig config;
 
     FPUArray fpuArray;        // member which stores the state of the grid
 
-    TimeOutList timeOutList; // list of pending time-outs
+    // lists of pending time-outs for the FPUs of each gateway.
+    // They are kept apart so that each RX thread only processes
+    // the time-outs of its own FPUs.
+    TimeOutList timeOutList[MAX_NUM_GATEWAYS];
 
-    CommandPool command_pool; // memory pool for unused command objects
 
 
 
@@ -300,17 +540,32 @@ int make_socket(const EtherCANInterfaceConfig &config, const char *ip, uint16_t
 
 
 // functions for enabling / disabling real-time scheduling
-// for time-critical broadcast commands.
+// of the calling thread, according to config.rt_scheduling
+
+E_RT_GUARANTEE set_rt_priority(const EtherCANInterfaceConfig &config, int prio);
+
+void unset_rt_priority(const EtherCANInterfaceConfig &config);
+
+// pins the calling thread to a CPU, if cpu is not negative
+E_RT_GUARANTEE set_thread_affinity(const EtherCANInterfaceConfig &config, int cpu);
+
+// locks the memory of the process and pre-faults a reserve of heap
+// and stack pages, if config.lock_memory is set. The result is
+// stored in the memory fields of rt_status.
+E_RT_GUARANTEE lock_memory(const EtherCANInterfaceConfig &config,
+                           t_rt_status &rt_status);
 
-void set_rt_priority(const EtherCANInterfaceConfig &config, int prio);
+void unlock_memory(const EtherCANInterfaceConfig &config);
 
-void unset_rt_priority();
 
+// heap which is pre-faulted when memory is locked, and stack
+// which is pre-faulted for the control and each I/O thread
+const size_t RT_HEAP_RESERVE_BYTES = 16 * 1024 * 1024;
+const size_t RT_STACK_RESERVE_BYTES = 256 * 1024;
 
-// real-time priority values for threads
-const int CONTROL_PRIORITY = 1;
-const int WRITER_PRIORITY = 2;
-const int READER_PRIORITY = 3;
+// time which connect() waits for the I/O threads
+// to report their real-time settings
+const long RT_SELF_CHECK_TIMEOUT_US = 1000000;
 
 }
 
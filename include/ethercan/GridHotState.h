@@ -0,0 +1,127 @@
+// -*- mode: c++ -*-
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME GridHotState.h
+//
+// This file defines a copy of the frequently scanned members of the
+// FPU states, which is stored as one array per member, and the scans
+// which work on it.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GRID_HOT_STATE_H
+#define GRID_HOT_STATE_H
+
+#include <time.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "../InterfaceConstants.h"
+#include "../FPUState.h"
+#include "../T_GridState.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+// boolean members of t_fpu_state which are mirrored
+// in t_grid_hot_state::flags
+enum E_HOT_FLAGS : uint8_t
+{
+    HF_PING_OK             = (1 << 0),
+    HF_MOVEMENT_COMPLETE   = (1 << 1),
+    HF_ALPHA_REFERENCED    = (1 << 2),
+    HF_BETA_REFERENCED     = (1 << 3),
+    HF_WAVEFORM_VALID      = (1 << 4),
+    HF_WAVEFORM_READY      = (1 << 5),
+    HF_AT_ALPHA_LIMIT      = (1 << 6),
+    HF_BETA_COLLISION      = (1 << 7),
+};
+
+// The FPU states in t_grid_state are large records, of which
+// scans over the whole grid typically need only one or two
+// members. This struct holds these members in separate arrays,
+// indexed by the FPU id, so that a scan reads only the memory it
+// needs. It is updated from the full records with
+// update_hot_state() whenever an FPU state changes. The arrays
+// have one entry for each configured FPU.
+typedef struct t_grid_hot_state
+{
+    std::vector<uint8_t> state;    // E_FPU_STATE
+    std::vector<uint8_t> flags;    // E_HOT_FLAGS
+    std::vector<uint32_t> pending_command_set;
+    std::vector<int32_t> alpha_steps;
+    std::vector<int32_t> beta_steps;
+    std::vector<timespec> last_updated;
+} t_grid_hot_state;
+
+// the same type as FPUArray::t_fpuset
+typedef bool t_hot_fpuset[MAX_NUM_POSITIONERS];
+
+
+inline void resize_hot_state(t_grid_hot_state& hot_state, const int num_fpus)
+{
+    hot_state.state.resize(num_fpus);
+    hot_state.flags.resize(num_fpus);
+    hot_state.pending_command_set.resize(num_fpus);
+    hot_state.alpha_steps.resize(num_fpus);
+    hot_state.beta_steps.resize(num_fpus);
+    hot_state.last_updated.resize(num_fpus);
+}
+
+
+inline void update_hot_state(t_grid_hot_state& hot_state, const int fpu_id,
+                             const t_fpu_state& fpu)
+{
+    hot_state.state[fpu_id] = fpu.state;
+    hot_state.flags[fpu_id] = ((fpu.ping_ok ? HF_PING_OK : 0)
+                               | (fpu.movement_complete ? HF_MOVEMENT_COMPLETE : 0)
+                               | (fpu.alpha_was_referenced ? HF_ALPHA_REFERENCED : 0)
+                               | (fpu.beta_was_referenced ? HF_BETA_REFERENCED : 0)
+                               | (fpu.waveform_valid ? HF_WAVEFORM_VALID : 0)
+                               | (fpu.waveform_ready ? HF_WAVEFORM_READY : 0)
+                               | (fpu.at_alpha_limit ? HF_AT_ALPHA_LIMIT : 0)
+                               | (fpu.beta_collision ? HF_BETA_COLLISION : 0));
+    hot_state.pending_command_set[fpu_id] = fpu.pending_command_set;
+    hot_state.alpha_steps[fpu_id] = fpu.alpha_steps;
+    hot_state.beta_steps[fpu_id] = fpu.beta_steps;
+    hot_state.last_updated[fpu_id] = fpu.last_updated;
+}
+
+
+// counts the states of the FPUs in fpuset
+void count_hot_states(const t_grid_hot_state& hot_state, const int num_fpus,
+                      const t_hot_fpuset& fpuset, t_counts& counts);
+
+// returns the number of FPUs in fpuset which are in
+// one of the states FPST_READY_FORWARD and FPST_READY_REVERSE
+int count_ready_hot(const t_grid_hot_state& hot_state, const int num_fpus,
+                    const t_hot_fpuset& fpuset);
+
+// returns true if all FPUs which are not locked have a time stamp
+// which differs from the one in old_timestamps
+bool check_all_fpus_updated_hot(const t_grid_hot_state& hot_state, const int num_fpus,
+                                const timespec* old_timestamps);
+
+// selects the FPUs in fpuset which are neither moving nor searching
+// datum, and returns their number
+int select_pingable_hot(const t_grid_hot_state& hot_state, const int num_fpus,
+                        const t_hot_fpuset& fpuset, t_hot_fpuset& selected);
+
+}
+
+}
+
+#endif
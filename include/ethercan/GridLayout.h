@@ -0,0 +1,126 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME GridLayout.h
+//
+// Assignment of the logical FPU ids to gateways, CAN buses and CAN
+// ids, according to the layout which is set in the configuration,
+// and the translation tables between both.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GRID_LAYOUT_H
+#define GRID_LAYOUT_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "../InterfaceConstants.h"
+#include "../InterfaceState.h"
+#include "../EtherCANInterfaceConfig.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+class GridLayout
+{
+public:
+
+    typedef struct t_bus_address
+    {
+        uint8_t gateway_id;
+        uint8_t bus_id;
+        uint8_t can_id;
+    } t_bus_address;
+
+    // FPU id for CAN addresses which do not belong to the layout
+    static const uint16_t NO_FPU = 0xffff;
+
+    GridLayout();
+
+    // checks the layout which is set in the configuration, and
+    // builds the translation tables for it. If the layout is
+    // invalid, DE_INVALID_CONFIG is returned.
+    E_EtherCANErrCode initialize(const EtherCANInterfaceConfig& config);
+
+    int getNumFPUs() const
+    {
+        return num_fpus;
+    }
+
+    int getBusesPerGateway() const
+    {
+        return buses_per_gateway;
+    }
+
+    int getFPUsPerBus() const
+    {
+        return fpus_per_bus;
+    }
+
+    int getFPUsPerGateway() const
+    {
+        return buses_per_gateway * fpus_per_bus;
+    }
+
+    // number of gateways which are needed for all FPUs
+    int getNumGateways() const
+    {
+        return (num_fpus + getFPUsPerGateway() - 1) / getFPUsPerGateway();
+    }
+
+    // number of FPUs which are connected to a bus of a gateway
+    int getNumFPUsOnBus(int gateway_id, int bus_id) const;
+
+    // CAN address of an FPU
+    const t_bus_address& getAddress(int fpu_id) const
+    {
+        return bus_addresses[fpu_id];
+    }
+
+    // Returns the FPU id for a CAN address. The mapping is defined
+    // for all CAN ids of all buses of all gateways, because the ids
+    // are registered using reverse lookup when FPUs respond to a
+    // broadcast, so the returned id can be larger than the number
+    // of FPUs. CAN id zero and addresses outside the layout return
+    // NO_FPU.
+    int getFPUId(int gateway_id, int bus_id, int can_id) const
+    {
+        if ((gateway_id >= MAX_NUM_GATEWAYS) || (bus_id >= buses_per_gateway)
+                || (can_id > fpus_per_bus))
+        {
+            return NO_FPU;
+        }
+        return fpu_ids[(((gateway_id * buses_per_gateway) + bus_id) * (1 + fpus_per_bus))
+                       + can_id];
+    }
+
+private:
+    int num_fpus;
+    int buses_per_gateway;
+    int fpus_per_bus;
+
+    // addresses indexed by FPU id
+    std::vector<t_bus_address> bus_addresses;
+    // FPU ids indexed by gateway, bus and CAN id
+    std::vector<uint16_t> fpu_ids;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,158 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME IOStatistics.h
+//
+// Counters of the socket and CAN bus traffic, which are updated by
+// the TX and RX threads, and which can be read at any time to
+// monitor the load of the gateways and buses. All counters start at
+// zero when the driver is created, and only increase.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IO_STATISTICS_H
+#define IO_STATISTICS_H
+
+#include <atomic>
+
+#include "../InterfaceConstants.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+// counters of one CAN bus
+typedef struct t_bus_io_stats
+{
+    unsigned long frames_sent;        // CAN messages sent to the bus
+    unsigned long bytes_sent;         // unencoded bytes of these messages
+    unsigned long delay_messages;     // gateway delay messages in front of them
+    unsigned long delay_ms;           // total delay requested by those, in ms
+    unsigned long frames_received;    // CAN messages received from the bus
+    unsigned long bytes_received;     // unencoded bytes of these messages
+    unsigned long unknown_fpu_frames; // received messages which map to no FPU
+    unsigned int max_queue_depth;     // maximum number of queued commands
+} t_bus_io_stats;
+
+// counters of one gateway connection
+typedef struct t_gateway_io_stats
+{
+    unsigned long send_calls;         // calls to send()
+    unsigned long socket_bytes_sent;  // bytes written to the socket
+    unsigned long partial_sends;      // send() calls which left bytes unsent
+    unsigned long send_would_block;   // send() calls which returned EWOULDBLOCK
+    unsigned long recv_calls;         // calls to recv()
+    unsigned long socket_bytes_received; // bytes read from the socket
+    unsigned long decode_sync_errors; // frames dropped because of framing errors
+    unsigned int max_queue_depth;     // maximum number of queued SYNC commands
+    unsigned long queue_full_waits;   // enqueued commands which waited for a full lane
+    t_bus_io_stats buses[MAX_BUSES_PER_GATEWAY];
+} t_gateway_io_stats;
+
+// counters of the whole driver
+typedef struct t_io_stats
+{
+    unsigned long tx_wakeups;  // returns from ppoll() in the TX thread
+    unsigned long rx_wakeups;  // returns from ppoll() in the RX thread
+    int num_gateways;          // number of connected gateways
+    int num_buses;             // number of buses per gateway
+    t_gateway_io_stats gateways[MAX_NUM_GATEWAYS];
+} t_io_stats;
+
+
+// The counters are grouped by the thread which updates them, so
+// that the TX and RX threads do not write to the same cache lines.
+// They are updated with relaxed atomic operations, so a copy can
+// be slightly inconsistent, but each counter is exact.
+class IOStatistics
+{
+public:
+
+    typedef std::atomic<unsigned long> t_counter;
+
+    // counters of a gateway which are updated by the TX thread
+    typedef struct t_tx_counters
+    {
+        t_counter send_calls;
+        t_counter socket_bytes_sent;
+        t_counter partial_sends;
+        t_counter send_would_block;
+        t_counter frames_sent[MAX_BUSES_PER_GATEWAY];
+        t_counter bytes_sent[MAX_BUSES_PER_GATEWAY];
+        t_counter delay_messages[MAX_BUSES_PER_GATEWAY];
+        t_counter delay_ms[MAX_BUSES_PER_GATEWAY];
+        char pad[64];
+    } t_tx_counters;
+
+    // counters of a gateway which are updated by the RX thread
+    typedef struct t_rx_counters
+    {
+        t_counter recv_calls;
+        t_counter socket_bytes_received;
+        t_counter decode_sync_errors;
+        t_counter frames_received[MAX_BUSES_PER_GATEWAY];
+        t_counter bytes_received[MAX_BUSES_PER_GATEWAY];
+        t_counter unknown_fpu_frames[MAX_BUSES_PER_GATEWAY];
+        char pad[64];
+    } t_rx_counters;
+
+    IOStatistics();
+
+    // sets all counters to zero
+    void reset();
+
+    static void add(t_counter& counter, unsigned long value=1)
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // records the depth of a command queue lane after a command
+    // was added (lane MAX_BUSES_PER_GATEWAY is the SYNC command lane)
+    void updateQueueDepth(const int gateway_id, const int lane, const unsigned int depth)
+    {
+        std::atomic<unsigned int>& max_depth = max_queue_depth[gateway_id][lane];
+        unsigned int old_max = max_depth.load(std::memory_order_relaxed);
+        while ((depth > old_max)
+                && (! max_depth.compare_exchange_weak(old_max, depth,
+                        std::memory_order_relaxed)))
+        {
+        }
+    }
+
+    // copies the counters. The numbers of gateways and buses and
+    // the waits for full command queue lanes are not known here,
+    // and are left zero.
+    void getStatistics(t_io_stats& out_stats) const;
+
+    // total delay of all inserted gateway delay messages, in ms
+    unsigned long getInsertedDelayMs() const;
+
+    t_tx_counters tx[MAX_NUM_GATEWAYS];
+    t_rx_counters rx[MAX_NUM_GATEWAYS];
+
+    t_counter tx_wakeups;
+    char pad0[64];
+    t_counter rx_wakeups;
+    char pad1[64];
+
+private:
+    // updated by the control thread(s)
+    std::atomic<unsigned int> max_queue_depth[MAX_NUM_GATEWAYS][MAX_BUSES_PER_GATEWAY + 1];
+};
+
+}
+
+}
+
+#endif
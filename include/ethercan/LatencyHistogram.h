@@ -0,0 +1,180 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME LatencyHistogram.h
+//
+// Histograms of the latencies in the life cycle of CAN commands,
+// which are recorded by the driver threads for each command type:
+//
+//   LM_ENQUEUE_TO_SEND     from sendCommand() in the control thread
+//                          until the TX thread hands the command to
+//                          send()
+//   LM_SEND_TO_RESPONSE    from sending until the RX thread has
+//                          dispatched the response which completes
+//                          the command
+//   LM_RESPONSE_TO_WAKEUP  from the reception of that response until
+//                          a waitForState() caller which it released
+//                          has woken up
+//   LM_QUEUE_DEPTH         number of queued commands when a command
+//                          is enqueued (not a time)
+//   LM_ABORT_TO_SOCKET     from abortMotion() until the abort messages
+//                          for a gateway are completely written to its
+//                          socket (recorded for CCMD_ABORT_MOTION)
+//
+// Times are recorded in microseconds. As in HDR histograms, the
+// buckets are spaced logarithmically with 16 linear sub-buckets per
+// power of two, so that each value is resolved to 1/16 (6 %) or
+// better, over the whole range of 32 bits.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "E_CAN_COMMAND.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+enum E_LATENCY_METRIC
+{
+    LM_ENQUEUE_TO_SEND    = 0,
+    LM_SEND_TO_RESPONSE   = 1,
+    LM_RESPONSE_TO_WAKEUP = 2,
+    LM_QUEUE_DEPTH        = 3,
+    LM_ABORT_TO_SOCKET    = 4,
+
+    NUM_LATENCY_METRICS   = 5,
+};
+
+const int LATENCY_SUB_BUCKET_BITS = 4;
+const int LATENCY_SUB_BUCKETS = (1 << LATENCY_SUB_BUCKET_BITS);
+const int NUM_LATENCY_BUCKETS = (LATENCY_SUB_BUCKETS
+                                 + (32 - LATENCY_SUB_BUCKET_BITS) * LATENCY_SUB_BUCKETS);
+
+// copy of one histogram
+typedef struct t_latency_histogram
+{
+    uint64_t count;  // number of recorded values
+    uint64_t sum;    // sum of all values
+    uint32_t max;    // largest value
+    uint32_t buckets[NUM_LATENCY_BUCKETS];
+} t_latency_histogram;
+
+
+// index of the bucket into which a value falls
+inline int latency_bucket_index(const uint32_t value)
+{
+    if (value < uint32_t(LATENCY_SUB_BUCKETS))
+    {
+        return int(value);
+    }
+    const int exponent = 31 - __builtin_clz(value);
+    const int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    return (LATENCY_SUB_BUCKETS * (shift + 1)
+            + int(value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// smallest and largest value which fall into a bucket
+uint32_t latency_bucket_lower(const int index);
+uint32_t latency_bucket_upper(const int index);
+
+// Returns the upper bound of the bucket which contains the value
+// below or at which the fraction p of all values lies. For p = 1,
+// the largest recorded value is returned.
+uint32_t latency_percentile(const t_latency_histogram& histogram, const double p);
+
+// Time stamp in microseconds of a monotonic time. It wraps around
+// after 71 minutes, which does not matter for differences of
+// shorter intervals.
+inline uint32_t latency_timestamp(const timespec& t)
+{
+    return uint32_t(uint64_t(t.tv_sec) * 1000000 + t.tv_nsec / 1000);
+}
+
+// Signed difference of two time stamps. It is negative if the end
+// was stamped before the start by another thread, for example when a
+// command is enqueued after the TX thread took the time stamp of its
+// batch.
+inline int64_t latency_interval(const uint32_t end_us, const uint32_t start_us)
+{
+    return int32_t(end_us - start_us);
+}
+
+
+// The histograms of all metrics and command types. Values can be
+// recorded concurrently from any thread without locking. Reading
+// and resetting histograms while values are recorded gives
+// approximate results, for example, a count which is not yet
+// matched by the buckets.
+class LatencyStats
+{
+public:
+
+    LatencyStats();
+
+    // adds a value to the histogram of a metric and command type.
+    // Negative values, which come from time stamps of different
+    // threads, are counted as zero.
+    void record(const E_LATENCY_METRIC metric, const E_CAN_COMMAND cmd_code,
+                const int64_t signed_value)
+    {
+        const uint32_t value = ((signed_value < 0) ? 0
+                                : ((signed_value > int64_t(UINT32_MAX)) ? UINT32_MAX
+                                   : uint32_t(signed_value)));
+        t_histogram& histogram = histograms[metric][cmd_code];
+        histogram.count.fetch_add(1, std::memory_order_relaxed);
+        histogram.sum.fetch_add(value, std::memory_order_relaxed);
+        histogram.buckets[latency_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t old_max = histogram.max.load(std::memory_order_relaxed);
+        while ((value > old_max)
+                && (! histogram.max.compare_exchange_weak(old_max, value,
+                        std::memory_order_relaxed)))
+        {
+        }
+    }
+
+    // Copies the histogram of a metric and command type. For
+    // CCMD_NO_COMMAND, the sum of the histograms of all command
+    // types is returned.
+    void getHistogram(const E_LATENCY_METRIC metric, const E_CAN_COMMAND cmd_code,
+                      t_latency_histogram& out_histogram) const;
+
+    // sets all histograms to zero
+    void reset();
+
+private:
+
+    typedef struct t_histogram
+    {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint32_t> max;
+        std::atomic<uint32_t> buckets[NUM_LATENCY_BUCKETS];
+    } t_histogram;
+
+    t_histogram histograms[NUM_LATENCY_METRICS][NUM_CAN_COMMANDS];
+};
+
+}
+
+}
+
+#endif
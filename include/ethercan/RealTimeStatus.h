@@ -0,0 +1,65 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME RealTimeStatus.h
+//
+// Result of the self-check of the real-time profile (see
+// EtherCANInterfaceConfig::rt_scheduling and ::lock_memory), which
+// tells which of the requested guarantees the driver has obtained
+// from the operating system.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef REAL_TIME_STATUS_H
+#define REAL_TIME_STATUS_H
+
+#include "../InterfaceConstants.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+enum E_RT_GUARANTEE
+{
+    RTG_NOT_REQUESTED = 0, // disabled in the configuration
+    RTG_OBTAINED      = 1,
+    RTG_FAILED        = 2, // requested, but refused by the system
+};
+
+typedef struct t_rt_thread_status
+{
+    E_RT_GUARANTEE scheduling; // SCHED_FIFO with the configured priority
+    E_RT_GUARANTEE affinity;   // pinned to the configured CPU
+} t_rt_thread_status;
+
+typedef struct t_rt_status
+{
+    // set by initializeInterface()
+    E_RT_GUARANTEE memory_locked;     // mlockall() of current and future pages
+    unsigned long locked_kb;          // locked memory of the process (VmLck)
+    unsigned long prefaulted_kb;      // heap and stack which was pre-faulted
+
+    // set by connect(). With a single TX and RX thread,
+    // only the first entries are used.
+    t_rt_thread_status control;       // thread which called connect()
+    int num_io_threads;               // number of TX threads, and of RX threads
+    t_rt_thread_status tx[MAX_NUM_GATEWAYS];
+    t_rt_thread_status rx[MAX_NUM_GATEWAYS];
+} t_rt_status;
+
+}
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME ReplayEngine.h
+//
+// This class replays a binary capture of the CAN traffic (see
+// CANCapture.h) through the receiving path of the driver, without
+// any hardware. Sent commands are registered as pending commands
+// with their time-outs, and received responses are re-encoded into
+// the byte stream of their gateway, and passed through
+// SBuffer::decode_buffer() and FPUArray::dispatchResponse(), as
+// the RX thread does. Time is taken from a virtual monotonic clock
+// which follows the time stamps of the capture, so that time-outs
+// expire as they did when the capture was recorded.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef REPLAY_ENGINE_H
+#define REPLAY_ENGINE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <vector>
+
+#include "../E_GridState.h"
+#include "../EtherCANInterfaceConfig.h"
+#include "../T_GridState.h"
+
+#include "CANCapture.h"
+#include "FPUArray.h"
+#include "I_ResponseHandler.h"
+#include "SBuffer.h"
+#include "TimeOutList.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+class ReplayEngine: private I_ResponseHandler
+{
+public:
+
+    // time value which stands for the end of the capture
+    static const uint64_t END_OF_CAPTURE = UINT64_MAX;
+
+    typedef struct t_replay_stats
+    {
+        unsigned long num_records;   // replayed records
+        unsigned long num_commands;  // sent commands, including broadcasts
+        unsigned long num_responses; // dispatched responses
+        unsigned long num_skipped;   // records which could not be replayed
+        double dispatch_time;        // seconds spent in decoding and
+                                     // dispatching responses
+    } t_replay_stats;
+
+
+    explicit ReplayEngine(const EtherCANInterfaceConfig &config_vals);
+    ~ReplayEngine();
+
+    E_EtherCANErrCode initialize();
+
+    E_EtherCANErrCode deInitialize();
+
+    // sets the records which are replayed. The records are not
+    // copied and need to stay valid until the replay is
+    // finished. The first record needs to start a session.
+    E_EtherCANErrCode setCapture(const t_capture_record* capture_records,
+                                 const long num_capture_records);
+
+    // replays all records up to the given time, in microseconds since
+    // the start of the capture, and processes the time-outs which
+    // expired until then. speed is the replay speed relative to the
+    // recorded time; zero replays at maximum speed.
+    E_EtherCANErrCode replayUntil(const uint64_t until_us, const double speed=0);
+
+    // returns true if all records were replayed
+    bool atEnd() const;
+
+    // time of the virtual clock, in microseconds since the
+    // start of the capture
+    uint64_t getReplayTime() const;
+
+    // get the current state of the FPU grid
+    E_GridState getGridState(t_grid_state& out_state) const;
+
+    void getStatistics(t_replay_stats& stats) const;
+
+private:
+
+    // registers a sent command as pending, as in
+    // GatewayInterface::updatePendingSets()
+    void replayCommand(const t_capture_message& msg, const timespec& cur_time);
+
+    void updatePendingCommand(const int fpu_id, const E_CAN_COMMAND cmd_code,
+                              const bool expects_response,
+                              const timespec& send_time,
+                              const timespec& deadline,
+                              const uint8_t sequence_number);
+
+    // appends a response to the received bytes of its gateway
+    void appendResponse(const t_capture_message& msg, const timespec& cur_time);
+
+    // decodes and dispatches all received bytes
+    void flushResponses();
+
+    // processes the time-outs which expired until cur_time
+    void expireTimeOuts(const timespec& cur_time);
+
+    // interface method which handles decoded CAN response messages
+    virtual void handleFrame(int const gateway_id, const t_CAN_buffer& command_buffer, int const clen);
+
+    // Size of the received bytes of a gateway which are decoded
+    // in one pass, as for one recv() call of the RX thread.
+    static const int RX_CHUNK_BYTES = 64 * 1024;
+
+    const EtherCANInterfaceConfig config;
+
+    FPUArray fpuArray;
+    TimeOutList timeOutList;
+    SBuffer sbuffer[MAX_NUM_GATEWAYS];
+
+    // mapping between addresses and FPU ids
+    GridLayout layout;
+
+    const t_capture_record* records;
+    long num_records;
+    long next_record;
+
+    // real time of the first session of the capture
+    uint64_t capture_start_ns;
+    // start of the current session, relative to capture_start_ns
+    int64_t session_offset_ns;
+    // virtual monotonic time, in nanoseconds since the capture start
+    uint64_t virtual_ns;
+    // next time-out, which is refreshed when the time-out list
+    // changes. All buffered responses are received before it.
+    timespec next_timeout;
+
+    // received bytes of each gateway which are not yet decoded,
+    // and the reception time of each contained frame
+    std::vector<uint8_t> rx_bytes[MAX_NUM_GATEWAYS];
+    std::vector<timespec> rx_times[MAX_NUM_GATEWAYS];
+    size_t rx_frame_index[MAX_NUM_GATEWAYS];
+
+    t_replay_stats statistics;
+};
+
+}
+
+}
+
+#endif
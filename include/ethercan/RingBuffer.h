@@ -10,10 +10,12 @@
 //------------------------------------------------------------------------------
 
 ////////////////////////////////////////////////////////////////////////////////
-// NAME CommandQueue.h
+// NAME RingBuffer.h
 //
-// This class implements a thread-safe array of FIFOs for commands to the ethercan
-// layer which can be queried and waited for efficiently
+// This class implements a lock-free FIFO for serialized commands
+// with a single consumer (the TX thread). Several threads can
+// enqueue commands, but CommandQueue serializes them with a lock,
+// so that the buffer sees a single producer at a time.
 //
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -21,63 +23,198 @@
 #define RINGBUFFER_H
 
 #include "../InterfaceConstants.h"
-#include "CAN_Command.h"
+#include "CommandRecord.h"
 
-#include "../EtherCANInterfaceConfig.h"
-#include "time_utils.h"
-#include "CommandPool.h"
-
-#include <memory>
+#include <atomic>
 #include <vector>
 
-using std::unique_ptr;
-
 
 namespace mpifps
 {
 
 namespace ethercanif
 {
-    class RingBuffer {
-
-    const int MAX_MESSAGE_CAPACITY = MAX_NUM_POSITIONERS * MAX_SUB_COMMANDS;
-
-    public:
-    RingBuffer() :
-    capacity(MAX_MESSAGE_CAPACITY){
-	buffer.resize(capacity);
-	    head = 0u;
-	    tail = 0u;
-	}
-	bool empty() const{
-	    return (head == tail);
-	}
-
-	void push_back(unique_ptr<CAN_Command> &command_ptr){
-	    assert(((head + 1) % capacity) != tail);
-	    buffer[head] = std::move(command_ptr);
-	    head = (head + 1) % capacity;
-	}
-
-	void push_front(unique_ptr<CAN_Command> &command_ptr){
-	    assert(((tail - 1 + capacity) % capacity) != head);
-	    buffer[tail] = std::move(command_ptr);
-	    tail = (tail - 1 + capacity) % capacity;
-	}
-
-	unique_ptr<CAN_Command> pop_front(){
-	    assert(! empty());
-	    unique_ptr<CAN_Command> rval = std::move(buffer[tail]);
-	    tail = (tail + 1) % capacity;
-	    return rval;
-	}
-
-    private:
-	unsigned const capacity;
-	std::vector<unique_ptr<CAN_Command>> buffer;
-	unsigned head;
-	unsigned tail;
-    };
+
+// information on a queued command, which
+// is used to schedule sending of commands
+typedef struct t_queue_entry_info
+{
+    uint64_t ticket; // running number which records the order of enqueueing
+    int fpu_id;
+    bool broadcast;
+} t_queue_entry_info;
+
+
+// A ring buffer holds the commands for one CAN bus of a
+// gateway. The command records are stored by value. The time
+// stamps of enqueueing are kept in a separate array, so that
+// the slots keep their size.
+//
+// The head index is only written by the producer, and the tail index
+// only by the consumer. Both are running 64-bit counters which never
+// wrap over, so that the buffer is empty if they are equal.  The
+// slot between tail and head are owned by the consumer, all others
+// by the producer. A release store of an index hands over the slots
+// to the other side.
+//
+// The producer side, try_push() and discard(), must be serialized
+// by the caller. discard() is called by the producer, and the
+// consumer drops the discarded commands in pop_discarded().
+
+class RingBuffer
+{
+public:
+
+    // Configuration of motion needs the most space, with up to
+    // MAX_SUB_COMMANDS messages for each FPU on the bus. The factor
+    // two leaves room for other commands.
+    static int messageCapacity(const int num_fpus_on_bus)
+    {
+        return 2 * num_fpus_on_bus * MAX_SUB_COMMANDS;
+    }
+
+    // the buffer has no capacity until allocate() is called
+    RingBuffer()
+    {
+        allocate(0);
+    }
+
+    // allocates room for the given number of commands, and
+    // empties the buffer. This must not be called concurrently
+    // with other methods.
+    void allocate(const int new_capacity)
+    {
+        capacity = uint64_t(new_capacity);
+        slots.resize(new_capacity);
+        enqueue_times.resize(new_capacity);
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        discard_until.store(0, std::memory_order_relaxed);
+        cached_tail = 0;
+    }
+
+    // number of commands which fit into the buffer
+    int getCapacity() const
+    {
+        return int(capacity);
+    }
+
+    // called by the consumer
+    bool empty() const
+    {
+        return (tail.load(std::memory_order_relaxed)
+                == head.load(std::memory_order_acquire));
+    }
+
+    // number of commands in the buffer. This reads the index of
+    // the other side, and is only used for statistics.
+    unsigned int size() const
+    {
+        return unsigned(head.load(std::memory_order_relaxed)
+                        - tail.load(std::memory_order_relaxed));
+    }
+
+    // adds a command at the end, and returns false if the buffer
+    // is full (called by the producer). enqueue_us is a time stamp
+    // from latency_timestamp().
+    bool try_push(const t_command_record& record, const uint64_t ticket,
+                  const uint32_t enqueue_us)
+    {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        if ((h - cached_tail) >= capacity)
+        {
+            // reading the tail of the consumer is only necessary
+            // when the buffer seems to be full
+            cached_tail = tail.load(std::memory_order_acquire);
+            if ((h - cached_tail) >= capacity)
+            {
+                return false;
+            }
+        }
+
+        t_slot& slot = slots[h % capacity];
+        slot.record = record;
+        slot.ticket = ticket;
+        enqueue_times[h % capacity] = enqueue_us;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // called by the consumer
+    void pop_front(t_command_record& record, uint32_t& enqueue_us)
+    {
+        assert(! empty());
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        record = slots[t % capacity].record;
+        enqueue_us = enqueue_times[t % capacity];
+        tail.store(t + 1, std::memory_order_release);
+    }
+
+    // information on the first entry, which is not removed
+    // (called by the consumer)
+    t_queue_entry_info front_info() const
+    {
+        assert(! empty());
+        const t_slot& slot = slots[tail.load(std::memory_order_relaxed) % capacity];
+        t_queue_entry_info info;
+        info.ticket = slot.ticket;
+        info.fpu_id = slot.record.fpu_id;
+        info.broadcast = (slot.record.flags & CRF_BROADCAST) != 0;
+        return info;
+    }
+
+    // marks all commands which are currently in the buffer as
+    // discarded (called by the producer)
+    void discard()
+    {
+        discard_until.store(head.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    // returns true if the consumer needs to drop discarded
+    // commands
+    bool has_discarded() const
+    {
+        return (tail.load(std::memory_order_relaxed)
+                < discard_until.load(std::memory_order_acquire));
+    }
+
+    // removes all commands which were discarded, and returns their
+    // number (called by the consumer)
+    int pop_discarded()
+    {
+        const uint64_t until = discard_until.load(std::memory_order_acquire);
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t >= until)
+        {
+            return 0;
+        }
+        tail.store(until, std::memory_order_release);
+        return int(until - t);
+    }
+
+private:
+    typedef struct t_slot
+    {
+        t_command_record record;
+        uint64_t ticket; // running number which records the order of enqueueing
+    } t_slot;
+
+    std::vector<t_slot> slots;
+    std::vector<uint32_t> enqueue_times; // time stamps of enqueueing, by slot
+    uint64_t capacity;
+
+    // the indices are kept on separate cache lines, so that
+    // producer and consumer do not invalidate each other's cache
+    // (padding is used because operator new does not support
+    // over-aligned types in C++11)
+    char pad0[64];
+    std::atomic<uint64_t> head;
+    uint64_t cached_tail; // last tail value seen by the producer
+    char pad1[64];
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> discard_until;
+    char pad2[64];
+};
 
 }
 }
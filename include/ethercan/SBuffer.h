@@ -24,10 +24,16 @@
 #include <string.h>		/// memset()
 #include <stdint.h>
 
+#include <atomic>
+#include <vector>
+
 #include "CAN_Constants.h"
 #include "../EtherCANInterfaceConfig.h"
 
 #include "I_ResponseHandler.h"  // interface for processing received CAN responses
+#include "frame_codec.h"  // byte stuffing and decoding of frames
+#include "CANLog.h"          // trace log of CAN messages
+#include "IOStatistics.h"    // traffic counters
 
 namespace mpifps
 {
@@ -64,6 +70,22 @@ public:
 
     void setConfig(const EtherCANInterfaceConfig &config_vals);
 
+    // allocates the read buffer, which is needed before
+    // data can be received
+    void allocateReadBuffer();
+
+    // discards unsent data and partially received frames
+    // which are left from a previous connection attempt
+    void resetBuffers();
+
+    // sets the trace log of CAN messages, and the id
+    // of the gateway which this buffer sends to
+    void setCANLog(CANLog* log, int gateway_id);
+
+    // sets the traffic counters which are updated for the
+    // gateway of this buffer
+    void setStatistics(IOStatistics* stats, int gateway_id);
+
     // encodes a buffer with a CAN message and sends it to
     // the socket identified with sockfd
     // this operation might block!
@@ -73,6 +95,22 @@ public:
                                    int busid,
                                    int fpu_canid);
 
+    // returns true if the write buffer is completely sent and
+    // has room for at least one more stuffed message, including
+    // a pre-pended gateway delay message. The number of bytes
+    // which are collected into one batch is limited by
+    // config.tx_batch_bytes.
+    bool canAppendMessage() const;
+
+    // encodes a buffer with a CAN message and appends it,
+    // together with any required gateway delay message, to
+    // the write buffer, without sending it. The collected
+    // batch is written with send_pending().
+    void encode_and_append(int const input_len,
+                           const uint8_t bytes[MAX_UNENCODED_GATEWAY_MESSAGE_BYTES],
+                           int busid,
+                           int fpu_canid);
+
     // we send pending data and return the
     // result of the send command.
     // note: positive number - all OK
@@ -81,14 +119,58 @@ public:
     E_SocketStatus send_pending(int sockfd);
 
     // number of bytes which still wait for being sent,
-    // from the last command.
+    // from the last batch of commands.
     int numUnsentBytes() const;
 
+    // Removes the unsent messages of the current batch, except the
+    // frame which is partially sent and urgent messages which were
+    // already inserted, so that no command which was buffered before
+    // an emergency stop is sent after it. Returns the number of
+    // removed messages, which are the last ones that were added by
+    // encode_and_append(), in the same order.
+    int discard_unsent();
+
+    // upper limit of the number of messages in one batch
+    static int maxBatchMessages()
+    {
+        return MAX_BATCH_MESSAGES;
+    }
+
+    // Urgent messages (the emergency stop) are inserted into the
+    // write buffer at the end of the frame which is currently being
+    // sent, in front of all other unsent messages (which are normally
+    // removed with discard_unsent() before), and without gateway
+    // delay messages. begin_urgent() finds the position, and
+    // returns false if there is not enough room for num_messages
+    // messages, which only happens if urgent messages were already
+    // inserted into the current batch. Each following call of
+    // insert_urgent() adds one message.
+    static const int MAX_URGENT_MESSAGES = MAX_BUSES_PER_GATEWAY;
+
+    bool begin_urgent(int num_messages);
+
+    void insert_urgent(int const input_len,
+                       const uint8_t bytes[MAX_UNENCODED_GATEWAY_MESSAGE_BYTES],
+                       int busid,
+                       int fpu_canid);
+
+    // returns true while inserted urgent messages are not
+    // completely sent
+    bool hasUnsentUrgent() const
+    {
+        return out_offset < urgent_end;
+    }
+
+    // computes the gateway delay, in milliseconds, which is needed
+    // before a message can be sent to the given bus and FPU. A
+    // fpu_canid of zero stands for a broadcast to the bus.
+    int getRequiredDelay(int busid, int fpu_canid) const;
+
     // reads data from a socket (which presumable has been
     // indicated to have new data available), unwraps and
     // stores read data bytes in an command buffer,
-    // and executes the response handler when a complete
-    // response has been received.
+    // and executes the response handler for each complete
+    // response which has been received.
     // the return value is either zero, or the
     // errno value when reading from the socket failed
     // (for example because the connection was closed
@@ -99,6 +181,18 @@ public:
     // socket has data available.
     E_SocketStatus decode_and_process(int sockfd, int gateway_id, I_ResponseHandler* rhandler);
 
+    // total number of bytes read by decode_and_process(). A
+    // change tells a busy-polling caller that data has arrived.
+    unsigned long getNumBytesReceived() const
+    {
+        return num_bytes_received;
+    }
+
+    // unwraps a chunk of bytes which were received from a gateway,
+    // and executes the response handler for each complete
+    // response. Incomplete frames are kept for the next call.
+    void decode_buffer(const uint8_t* buf, int len, int gateway_id, I_ResponseHandler* rhandler);
+
 private:
 
 
@@ -109,24 +203,65 @@ private:
     // swizzled to two bytes.
     static const int MAX_STUFFED_MESSAGE_LENGTH = (4 + 2 * MAX_UNENCODED_GATEWAY_MESSAGE_BYTES);
 
+    // Size of the write buffer. Several messages are collected into
+    // it so that they can be written with a single send() call.
+    static const int MAX_TX_BATCH_BYTES = 4096;
+
     const int max_gw_delay = 0xff;
 
 
-    // read buffer for data from socket
-    uint8_t rbuf[MAX_STUFFED_MESSAGE_LENGTH];
-    bool sync;
-    bool dle;
+    // Size of the read buffer. A large buffer allows to decode all
+    // data which is available on the socket with a single recv() call.
+    static const int RECV_BUFFER_SIZE = 64 * 1024;
+
+    // read buffer for data from socket, allocated by
+    // allocateReadBuffer() for the gateways which are connected
+    std::vector<uint8_t> rbuf;
+    // decoder state, holding the current partial frame
+    t_frame_decoder decoder;
+    unsigned long num_bytes_received;
     int unsent_len;
     int out_offset;
-    // internal buffer for command
-    t_CAN_buffer command_buf;
-    uint8_t bus_delays[BUSES_PER_GATEWAY];
-    uint8_t fpu_delays[BUSES_PER_GATEWAY][FPUS_PER_BUS];
+    uint8_t bus_delays[MAX_BUSES_PER_GATEWAY];
+    // indexed by bus * config.fpus_per_bus + (CAN id - 1)
+    std::vector<uint8_t> fpu_delays;
+
+    // updates the running delays for all buses and FPUs
+    // after a message with the given delay was sent
+    void count_delays(int busid, int fpu_canid, int gw_delay);
+
+    // position of the first frame boundary at or after out_offset
+    int next_frame_boundary() const;
+
+    // Every message of a batch takes at least four bytes for the
+    // frame delimiters, which limits the number of messages.
+    static const int MAX_BATCH_MESSAGES = MAX_TX_BATCH_BYTES / 4;
+
+    // end positions in wbuf of the messages which were added
+    // by encode_and_append() to the current batch
+    int message_end[MAX_BATCH_MESSAGES];
+    int num_batch_messages;
+
+    // room for urgent messages, in addition to a full batch
+    static const int URGENT_RESERVE_BYTES = 2 * MAX_URGENT_MESSAGES * MAX_STUFFED_MESSAGE_LENGTH;
+
+    // end of the urgent messages in wbuf, or zero
+    int urgent_end;
+
+    // maximum fill level of wbuf, derived from config.tx_batch_bytes
+    int batch_limit;
+
+    // write buffer for one batch of stuffed messages. Each message
+    // can be preceded by a delay message, which needs the same space.
+    uint8_t wbuf[MAX_TX_BATCH_BYTES + URGENT_RESERVE_BYTES];
 
-    // length of command
-    int clen;
+    // trace log of sent messages
+    CANLog* can_log;
+    int log_gateway_id;
 
-    uint8_t wbuf[2 * MAX_STUFFED_MESSAGE_LENGTH];
+    // traffic counters of the gateway, or null
+    IOStatistics::t_tx_counters* tx_stats;
+    IOStatistics::t_rx_counters* rx_stats;
 
     // this isn't declared as const because sbuffer is an array member
     // in use, and C++11 lacks a pratical way to initialize this
@@ -24,8 +24,12 @@
 #include <time.h>
 #include "time_utils.h"
 #include <pthread.h>
+#include <stdint.h>
+
+#include <vector>
 
 #include "../InterfaceConstants.h"
+#include "E_CAN_COMMAND.h"
 
 
 
@@ -36,14 +40,24 @@ namespace mpifps
 namespace ethercanif
 {
 
+// The list holds one timer for each pair of FPU and command code,
+// for a range of consecutive FPU ids (the FPUs of one gateway).
+// The timers of each command code are kept in a doubly linked list
+// which is ordered by time-out value. Because every command type
+// has a fixed time-out, and commands are sent in chronological
+// order, a new timer almost always belongs at the tail of its list,
+// so that arming, cancelling and expiring a timer is O(1), and the
+// next time-out is the minimum of the list heads.
+
 class TimeOutList
 {
 public:
 
     typedef struct
     {
-        timespec val; // absolute value of next time-out
+        timespec val; // absolute value of the time-out
         int id; // corresponding fpu id
+        E_CAN_COMMAND cmd_code; // command which timed out
     } t_toentry;
 
     static const timespec MAX_TIMESPEC;
@@ -52,49 +66,72 @@ public:
 
     ~TimeOutList() {};
 
+    // allocates the timers for the FPU ids first_id to
+    // first_id + num_ids - 1, and clears all time-outs. This
+    // must be called before the list is used, and not
+    // concurrently with other methods.
+    void setIdRange(int const first_id, int const num_ids);
+
     // All public methods are thread-safe.
     // Beware using internal methods without
     // locking.
 
-    // insert new value into list
+    // sets the time-out for a command to an FPU. An already
+    // armed time-out for the same command is replaced.
     // This is a O(1) operation
-    void insertTimeOut(int const id, timespec const val);
+    void armTimeOut(int const id, E_CAN_COMMAND const cmd_code, timespec val);
 
-    // clear value from list
+    // cancels the time-out for a command, if it is armed.
     // This is a O(1) operation
-    void clearTimeOut(int const id);
+    void cancelTimeOut(int const id, E_CAN_COMMAND const cmd_code);
 
 
-    // get time and id of next time-out event.  The returned time
+    // get time of next time-out event.  The returned time
     // value is Linux' monotonic clock. If no time_out is pending,
     // MAX_TIMESPEC is returned.
     //
-    // This is O(N) in the worst case but is optimized toward O(1) in
-    // typical use, when most entries have the same value.
+    // This is O(1), it compares the heads of the non-empty lists.
     const timespec getNextTimeOut();
 
-    // get and remove item with minimum value
-    t_toentry pop();
+    // removes up to max_entries time-outs which are not later than
+    // cur_time, stores them in expired, and returns their number.
+    // The cost is proportional to the number of removed entries.
+    int popExpired(timespec const cur_time, t_toentry* expired, int const max_entries);
 
 
 private:
 
+    static const int32_t NO_TIMER = -1;
 
-    // get current minimum key (timeout value)
-    // This method is not thread-safe!
-    const timespec minKey();
+    typedef struct t_timer
+    {
+        timespec val;  // absolute time-out, if armed
+        int32_t prev;  // neighbours in the list of the command code
+        int32_t next;
+        bool armed;
+    } t_timer;
+
+    // index of the timer for a command to an FPU
+    int timerIndex(int const id, E_CAN_COMMAND const cmd_code) const
+    {
+        return (id - first_id) * NUM_CAN_COMMANDS + cmd_code;
+    }
 
-    const timespec search_min();
+    // these methods are not thread-safe!
+    void unlink(int32_t const idx);
+    void insertOrdered(int32_t const idx);
 
+    int first_id;
+    int num_ids;
+    std::vector<t_timer> timers;
+    int32_t list_head[NUM_CAN_COMMANDS];
+    int32_t list_tail[NUM_CAN_COMMANDS];
+    // bit mask of the lists which are not empty
+    uint32_t nonempty_lists;
 
-    timespec TimeOutsByID[MAX_NUM_POSITIONERS];
     // this mutex protects the list form concurrent access
     pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    timespec cached_minimum;
-    int cached_minimum_multiplicity;
-    int minimum_index_lbound;
-
 };
 
 }
@@ -24,6 +24,7 @@
 #include <cassert>
 
 #include <string.h>
+#include <stdlib.h> // abs()
 
 #include "../CAN_Command.h"
 
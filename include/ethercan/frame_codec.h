@@ -0,0 +1,279 @@
+// -*- mode: c++ -*-
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2017 UKRI. See file "LICENSE" for license information.
+//
+// Who       When        What
+// --------  ----------  -------------------------------------------------------
+// Pablo Gutierrez 2017-07-22  created CAN client sample
+// jnix      2017-10-18  Created driver class using Pablo Guiterrez' CAN client sample
+//------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////////////
+// NAME frame_codec.h
+//
+// Inline functions for the DLE / STX / ETX framing (byte stuffing) of
+// messages which are exchanged with the EtherCAN gateways.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <stdint.h>
+#include <string.h>		/// memchr(), memcpy()
+
+#include "CAN_Constants.h"
+#include "CAN_Command.h"
+
+namespace mpifps
+{
+
+namespace ethercanif
+{
+
+const uint8_t STX = 0x02;
+const uint8_t ETX = 0x03;
+const uint8_t DLE = 0x10;
+
+
+inline void byte_stuff(uint8_t * buf, int& out_len, uint8_t const b)
+{
+    if (b==DLE)
+    {
+        buf[out_len++] = b;
+    }
+
+    buf[out_len++] = b;
+}
+
+inline void encode_buffer(int const input_len, uint8_t const * const src,
+                          int& output_len, uint8_t * const dst)
+{
+    // The output position is a pointer, so that no signed
+    // arithmetic on the lengths is folded into the loop condition.
+    uint8_t* out = dst;
+    *out++ = DLE;
+    *out++ = STX;
+
+    uint8_t const * const end = src + input_len;
+    for (uint8_t const * in = src; in != end; in++)
+    {
+        if (*in == DLE)
+        {
+            *out++ = DLE;
+        }
+        *out++ = *in;
+    }
+
+    *out++ = DLE;
+    *out++ = ETX;
+    output_len = int(out - dst);
+}
+
+
+// Decodes a single byte. Returns true when frame is complete.
+//
+// This is the original byte-by-byte decoder. It is kept as a
+// reference for decode_frames() below, which does the same job for
+// whole buffers.
+inline bool decode_and_append_byte(uint8_t* buf,
+                                   int& buflen,
+                                   bool& sync,
+                                   bool& dle,
+                                   uint8_t data)
+{
+    bool frame_complete = false;
+
+    if (data == DLE && (!dle))
+    {
+        dle = true;
+        return frame_complete;
+    }
+
+    if (dle)
+    {
+        dle = false;
+        switch (data)
+        {
+        case STX:
+            // start a new frame
+            sync = true;
+            buflen = 0;
+            return frame_complete;
+
+        case ETX:
+            // this marks the end of a frame
+            if (sync)
+            {
+                sync = false;
+                frame_complete = true;
+            }
+            return frame_complete;
+
+        case DLE:
+            // interpret this DLE byte as data
+            break;
+
+        default:
+            sync = false;
+            // invalid sequence, skip frame
+            return frame_complete;
+        }
+    }
+
+    if (sync)
+    {
+        if (buflen < MAX_UNENCODED_GATEWAY_MESSAGE_BYTES)
+        {
+            buf[buflen++] = data;
+        }
+        else
+        {
+            // maximum frame length was exceeded, ignore frame
+            sync = false;
+        }
+    }
+    else
+    {
+        sync = false;
+    }
+    return frame_complete;
+}
+
+
+// state of the stream decoder, which is kept between
+// successive chunks of received data
+typedef struct t_frame_decoder
+{
+    bool sync; // we are within a frame
+    bool dle;  // the last byte was an unpaired DLE
+    int clen;  // length of the decoded frame
+    unsigned long num_sync_errors; // frames which were dropped
+    t_CAN_buffer frame;
+
+    t_frame_decoder()
+    {
+        sync = false;
+        dle = false;
+        clen = 0;
+        num_sync_errors = 0;
+        memset(frame.bytes, 0, sizeof(frame.bytes));
+    }
+} t_frame_decoder;
+
+
+// Decodes a buffer of received bytes, calling on_frame(frame, clen)
+// for each complete frame.
+//
+// Because DLE bytes are rare in the payload, the runs of
+// data bytes between them are located with memchr() and copied
+// as a block, instead of running the state machine for every byte.
+// The result is identical to feeding each byte to
+// decode_and_append_byte().
+
+template<typename T_FrameHandler>
+inline void decode_frames(t_frame_decoder& dec,
+                          const uint8_t* data, const size_t len,
+                          T_FrameHandler&& on_frame)
+{
+    const uint8_t* p = data;
+    const uint8_t* const end = data + len;
+
+    while (p < end)
+    {
+        if (dec.dle)
+        {
+            // the byte following a DLE is a control code
+            dec.dle = false;
+            const uint8_t code = *p++;
+            switch (code)
+            {
+            case STX:
+                // start a new frame
+                if (dec.sync)
+                {
+                    // the previous frame was not terminated
+                    dec.num_sync_errors++;
+                }
+                dec.sync = true;
+                dec.clen = 0;
+                break;
+
+            case ETX:
+                // this marks the end of a frame
+                if (dec.sync)
+                {
+                    dec.sync = false;
+                    on_frame(dec.frame, dec.clen);
+                }
+                break;
+
+            case DLE:
+                // escaped DLE, which is interpreted as data
+                if (dec.sync)
+                {
+                    if (dec.clen < MAX_UNENCODED_GATEWAY_MESSAGE_BYTES)
+                    {
+                        dec.frame.bytes[dec.clen++] = code;
+                    }
+                    else
+                    {
+                        // maximum frame length was exceeded, ignore frame
+                        dec.sync = false;
+                        dec.num_sync_errors++;
+                    }
+                }
+                break;
+
+            default:
+                // invalid sequence, skip frame
+                if (dec.sync)
+                {
+                    dec.sync = false;
+                    dec.num_sync_errors++;
+                }
+                break;
+            }
+            continue;
+        }
+
+        // find the next DLE, and copy all data bytes in front of it
+        const uint8_t* q = static_cast<const uint8_t*>(memchr(p, DLE, end - p));
+        if (q == nullptr)
+        {
+            q = end;
+        }
+
+        if (dec.sync)
+        {
+            const int nbytes = q - p;
+            if (dec.clen + nbytes <= MAX_UNENCODED_GATEWAY_MESSAGE_BYTES)
+            {
+                memcpy(dec.frame.bytes + dec.clen, p, nbytes);
+                dec.clen += nbytes;
+            }
+            else
+            {
+                // maximum frame length was exceeded, ignore frame
+                dec.sync = false;
+                dec.num_sync_errors++;
+            }
+        }
+
+        p = q;
+        if (p < end)
+        {
+            // skip the DLE, the next byte is interpreted as code
+            dec.dle = true;
+            p++;
+        }
+    }
+}
+
+}
+
+}
+
+#endif
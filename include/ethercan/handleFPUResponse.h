@@ -32,7 +32,8 @@ namespace ethercanif
 void handleFPUResponse(const EtherCANInterfaceConfig &config,
                        int fpu_id, t_fpu_state& fpu,
                        const t_response_buf& data,
-                       const int blen, TimeOutList& timeout_list,
+                       const int blen, const timespec& cur_time,
+                       TimeOutList& timeout_list,
                        unsigned int &count_pending);
 
 }
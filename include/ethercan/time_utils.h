@@ -82,7 +82,7 @@ static inline void set_normalized_timespec(struct timespec &new_val,
     if (_tv_nsec * sign < 0)
     {
         _tv_nsec += nano * sign;
-        _tv_nsec -= (1 * sign);
+        _tv_sec -= sign;
     }
 
     new_val.tv_sec = _tv_sec;
@@ -205,6 +205,8 @@ class UnprotectedGridDriver (object):
                  waveform_upload_pause_us=0,
                  configmotion_max_retry_count=5,
                  configmotion_max_resend_count=10,
+                 configmotion_window=0,
+                 configmotion_skip_unchanged=False,
                  min_bus_repeat_delay_ms = 0,
 	             min_fpu_repeat_delay_ms = 1,
                  alpha_datum_offset=ALPHA_DATUM_OFFSET,
@@ -220,6 +222,7 @@ class UnprotectedGridDriver (object):
                  control_logfile="_{start_timestamp}-fpu_control.log",
                  tx_logfile = "_{start_timestamp}-fpu_tx.log",
                  rx_logfile = "_{start_timestamp}-fpu_rx.log",
+                 capture_file = None,
                  start_timestamp="ISO8601"):
 
         self.lock = threading.RLock()
@@ -244,6 +247,8 @@ class UnprotectedGridDriver (object):
         config.confirm_each_step = confirm_each_step
         config.configmotion_max_retry_count = configmotion_max_retry_count
         config.configmotion_max_resend_count = configmotion_max_resend_count
+        config.configmotion_window = configmotion_window
+        config.configmotion_skip_unchanged = configmotion_skip_unchanged
         config.waveform_upload_pause_us = waveform_upload_pause_us
        	config.min_bus_repeat_delay_ms = min_bus_repeat_delay_ms
         config.min_fpu_repeat_delay_ms = min_fpu_repeat_delay_ms
@@ -278,6 +283,15 @@ class UnprotectedGridDriver (object):
         config.fd_txlog = os.open(tx_filename, flags, mode)
         config.fd_rxlog = os.open(rx_filename, flags, mode)
 
+        # The binary capture of the CAN traffic is optional. It
+        # can be decoded with the tools/decode_capture program.
+        if capture_file is not None:
+            capture_filename = get_logname(capture_file,
+                                           log_dir=log_path,
+                                           timestamp=start_timestamp)
+            config.fd_capturelog = os.open(capture_filename, flags, mode)
+            print("    capture file: %s" % capture_filename)
+
         # Check the log files have actually been opened successfully
         if config.fd_controllog > 0:
            print("CONTROL log file: %s" % control_filename)
@@ -311,6 +325,8 @@ class UnprotectedGridDriver (object):
         os.close(self.config.fd_controllog)
         os.close(self.config.fd_txlog)
         os.close(self.config.fd_rxlog)
+        if self.config.fd_capturelog >= 0:
+            os.close(self.config.fd_capturelog)
 
     def _post_connect_hook(self, config):
         pass